@@ -0,0 +1,381 @@
+#include "Bvh.hpp"
+
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <random>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+        const int BIN_COUNT = 16;
+        const int MAX_DEPTH = 48;
+        const unsigned int MAX_LEAF_SIZE = 4;
+        // subtrees larger than this are built on their own thread
+        const unsigned int PARALLEL_THRESHOLD = 4096;
+
+        float SurfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+            glm::vec3 e = boxMax - boxMin;
+            return e.x * e.y + e.y * e.z + e.z * e.x;
+        }
+
+        // Moller-Trumbore, returns the distance along the ray or a negative value on a miss
+        float IntersectRayTriangle(const Ray& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+            glm::vec3 edge1 = v1 - v0;
+            glm::vec3 edge2 = v2 - v0;
+            glm::vec3 h = glm::cross(ray.direction, edge2);
+            float a = glm::dot(edge1, h);
+            if (std::fabs(a) < 1e-8f)
+                return -1.0f;
+            float f = 1.0f / a;
+            glm::vec3 s = ray.origin - v0;
+            float u = f * glm::dot(s, h);
+            if (u < 0.0f || u > 1.0f)
+                return -1.0f;
+            glm::vec3 q = glm::cross(s, edge1);
+            float v = f * glm::dot(ray.direction, q);
+            if (v < 0.0f || u + v > 1.0f)
+                return -1.0f;
+            return f * glm::dot(edge2, q);
+        }
+
+        double ElapsedMs(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    void Bvh::Build(const std::vector<BoundingBox>& primitiveBoxes) {
+        boxes = primitiveBoxes;
+        nodes.clear();
+        primitiveIndices.clear();
+        centroids.clear();
+        if (boxes.empty())
+            return;
+
+        unsigned int count = (unsigned int)boxes.size();
+        primitiveIndices.resize(count);
+        centroids.resize(count);
+        for (unsigned int i = 0; i < count; i++) {
+            primitiveIndices[i] = i;
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        }
+
+        // a binary tree with n leaves has at most 2n - 1 nodes, so the array never reallocates
+        nodes.resize(2 * count);
+        BvhNode& root = nodes[0];
+        root.leftFirst = 0;
+        root.count = count;
+        UpdateBounds(0);
+
+        std::atomic<unsigned int> nodesUsed(1);
+        Subdivide(0, 0, nodesUsed);
+        nodes.resize(nodesUsed.load());
+    }
+
+    void Bvh::UpdateBounds(unsigned int nodeIndex) {
+        BvhNode& node = nodes[nodeIndex];
+        node.min = glm::vec3(FLT_MAX);
+        node.max = glm::vec3(-FLT_MAX);
+        for (unsigned int i = 0; i < node.count; i++) {
+            const BoundingBox& box = boxes[primitiveIndices[node.leftFirst + i]];
+            node.min = glm::min(node.min, box.min);
+            node.max = glm::max(node.max, box.max);
+        }
+    }
+
+    float Bvh::FindBestSplit(const BvhNode& node, int& bestAxis, float& bestPosition) const {
+        float bestCost = FLT_MAX;
+
+        for (int axis = 0; axis < 3; axis++) {
+            // bins are placed over the centroid bounds, not the node bounds
+            float boundsMin = FLT_MAX, boundsMax = -FLT_MAX;
+            for (unsigned int i = 0; i < node.count; i++) {
+                float c = centroids[primitiveIndices[node.leftFirst + i]][axis];
+                boundsMin = glm::min(boundsMin, c);
+                boundsMax = glm::max(boundsMax, c);
+            }
+            if (boundsMin == boundsMax)
+                continue;
+
+            glm::vec3 binMin[BIN_COUNT], binMax[BIN_COUNT];
+            unsigned int binCount[BIN_COUNT];
+            for (int b = 0; b < BIN_COUNT; b++) {
+                binMin[b] = glm::vec3(FLT_MAX);
+                binMax[b] = glm::vec3(-FLT_MAX);
+                binCount[b] = 0;
+            }
+
+            float scale = BIN_COUNT / (boundsMax - boundsMin);
+            for (unsigned int i = 0; i < node.count; i++) {
+                unsigned int primitive = primitiveIndices[node.leftFirst + i];
+                int b = std::min(BIN_COUNT - 1, (int)((centroids[primitive][axis] - boundsMin) * scale));
+                binCount[b]++;
+                binMin[b] = glm::min(binMin[b], boxes[primitive].min);
+                binMax[b] = glm::max(binMax[b], boxes[primitive].max);
+            }
+
+            // sweep from both sides to get the area/count left and right of every plane
+            float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+            unsigned int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+            glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+            unsigned int leftSum = 0, rightSum = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++) {
+                leftSum += binCount[b];
+                leftCount[b] = leftSum;
+                leftMin = glm::min(leftMin, binMin[b]);
+                leftMax = glm::max(leftMax, binMax[b]);
+                leftArea[b] = leftSum > 0 ? SurfaceArea(leftMin, leftMax) : 0.0f;
+
+                int r = BIN_COUNT - 1 - b;
+                rightSum += binCount[r];
+                rightCount[r - 1] = rightSum;
+                rightMin = glm::min(rightMin, binMin[r]);
+                rightMax = glm::max(rightMax, binMax[r]);
+                rightArea[r - 1] = rightSum > 0 ? SurfaceArea(rightMin, rightMax) : 0.0f;
+            }
+
+            float binWidth = (boundsMax - boundsMin) / BIN_COUNT;
+            for (int b = 0; b < BIN_COUNT - 1; b++) {
+                float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPosition = boundsMin + binWidth * (b + 1);
+                }
+            }
+        }
+        return bestCost;
+    }
+
+    void Bvh::Subdivide(unsigned int nodeIndex, int depth, std::atomic<unsigned int>& nodesUsed) {
+        BvhNode& node = nodes[nodeIndex];
+        if (node.count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH)
+            return;
+
+        int axis = 0;
+        float splitPosition = 0.0f;
+        float splitCost = FindBestSplit(node, axis, splitPosition);
+        float leafCost = node.count * SurfaceArea(node.min, node.max);
+        if (splitCost >= leafCost)
+            return;
+
+        // partition the primitive range in place
+        int i = (int)node.leftFirst;
+        int j = i + (int)node.count - 1;
+        while (i <= j) {
+            if (centroids[primitiveIndices[i]][axis] < splitPosition)
+                i++;
+            else
+                std::swap(primitiveIndices[i], primitiveIndices[j--]);
+        }
+        unsigned int leftCount = (unsigned int)i - node.leftFirst;
+        if (leftCount == 0 || leftCount == node.count)
+            return;
+
+        unsigned int leftIndex = nodesUsed.fetch_add(2);
+        unsigned int rightIndex = leftIndex + 1;
+        nodes[leftIndex].leftFirst = node.leftFirst;
+        nodes[leftIndex].count = leftCount;
+        nodes[rightIndex].leftFirst = (unsigned int)i;
+        nodes[rightIndex].count = node.count - leftCount;
+        node.leftFirst = leftIndex;
+        node.count = 0;
+        UpdateBounds(leftIndex);
+        UpdateBounds(rightIndex);
+
+        // both halves work on disjoint ranges of primitiveIndices, so big ones can run in parallel
+        if (nodes[leftIndex].count > PARALLEL_THRESHOLD && nodes[rightIndex].count > PARALLEL_THRESHOLD) {
+            std::future<void> left = std::async(std::launch::async, [this, leftIndex, depth, &nodesUsed]() {
+                Subdivide(leftIndex, depth + 1, nodesUsed);
+            });
+            Subdivide(rightIndex, depth + 1, nodesUsed);
+            left.get();
+        }
+        else {
+            Subdivide(leftIndex, depth + 1, nodesUsed);
+            Subdivide(rightIndex, depth + 1, nodesUsed);
+        }
+    }
+
+    void Bvh::QueryFrustum(const gps::Frustum& frustum, std::vector<unsigned int>& result) const {
+        if (!nodes.empty())
+            QueryFrustum(0, frustum, false, result);
+    }
+
+    void Bvh::QueryFrustum(unsigned int nodeIndex, const gps::Frustum& frustum, bool inside, std::vector<unsigned int>& result) const {
+        const BvhNode& node = nodes[nodeIndex];
+
+        if (!inside) {
+            BoundingBox box;
+            box.min = node.min;
+            box.max = node.max;
+            FRUSTUM_TEST test = frustum.classify(box);
+            if (test == FRUSTUM_OUTSIDE)
+                return;
+            // a node completely inside needs no more plane tests below it
+            inside = test == FRUSTUM_INSIDE;
+        }
+
+        if (node.count > 0) {
+            for (unsigned int i = 0; i < node.count; i++) {
+                unsigned int primitive = primitiveIndices[node.leftFirst + i];
+                if (inside || frustum.isVisible(boxes[primitive]))
+                    result.push_back(primitive);
+            }
+            return;
+        }
+
+        QueryFrustum(node.leftFirst, frustum, inside, result);
+        QueryFrustum(node.leftFirst + 1, frustum, inside, result);
+    }
+
+    const std::vector<BvhNode>& Bvh::getNodes() const {
+        return nodes;
+    }
+
+    bool Bvh::isEmpty() const {
+        return nodes.empty();
+    }
+
+    void SceneBvh::Build(gps::Model3D& model, glm::mat4 modelMatrix) {
+        this->modelMatrix = modelMatrix;
+        this->inverseModelMatrix = glm::inverse(modelMatrix);
+
+        std::vector<gps::Mesh>& modelMeshes = model.getMeshes();
+        meshes.clear();
+        triangleBvhs.assign(modelMeshes.size(), gps::Bvh());
+
+        std::vector<BoundingBox> meshBoxes;
+        BoxList worldBoxes;
+        for (size_t i = 0; i < modelMeshes.size(); i++) {
+            meshes.push_back(&modelMeshes[i]);
+            worldBoxes.push(modelMeshes[i].bounds, modelMatrix);
+            BoundingBox box;
+            box.min = glm::vec3(worldBoxes.centerX[i] - worldBoxes.extentX[i], worldBoxes.centerY[i] - worldBoxes.extentY[i], worldBoxes.centerZ[i] - worldBoxes.extentZ[i]);
+            box.max = glm::vec3(worldBoxes.centerX[i] + worldBoxes.extentX[i], worldBoxes.centerY[i] + worldBoxes.extentY[i], worldBoxes.centerZ[i] + worldBoxes.extentZ[i]);
+            meshBoxes.push_back(box);
+        }
+        meshBvh.Build(meshBoxes);
+
+        // triangle hierarchies are independent, build them on all cores
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::atomic<size_t> nextMesh(0);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threadCount; t++) {
+            workers.push_back(std::thread([this, &nextMesh]() {
+                for (size_t m = nextMesh++; m < meshes.size(); m = nextMesh++) {
+                    const gps::Mesh* mesh = meshes[m];
+                    // only the full detail level, which starts the index buffer
+                    std::vector<BoundingBox> triangleBoxes(mesh->lods[0].indexCount / 3);
+                    for (size_t t = 0; t < triangleBoxes.size(); t++) {
+                        const glm::vec3& v0 = mesh->vertices[mesh->indices[3 * t + 0]].Position;
+                        const glm::vec3& v1 = mesh->vertices[mesh->indices[3 * t + 1]].Position;
+                        const glm::vec3& v2 = mesh->vertices[mesh->indices[3 * t + 2]].Position;
+                        triangleBoxes[t].min = glm::min(v0, glm::min(v1, v2));
+                        triangleBoxes[t].max = glm::max(v0, glm::max(v1, v2));
+                    }
+                    triangleBvhs[m].Build(triangleBoxes);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+    }
+
+    void SceneBvh::QueryFrustum(const gps::Frustum& frustum, std::vector<unsigned int>& result) const {
+        meshBvh.QueryFrustum(frustum, result);
+    }
+
+    bool SceneBvh::Raycast(const Ray& ray, RayHit& hit) const {
+        // triangles are tested in object space, distances stay comparable for rigid model matrices
+        Ray localRay;
+        localRay.origin = glm::vec3(inverseModelMatrix * glm::vec4(ray.origin, 1.0f));
+        localRay.direction = glm::vec3(inverseModelMatrix * glm::vec4(ray.direction, 0.0f));
+
+        hit.mesh = -1;
+        hit.triangle = -1;
+        float closest = meshBvh.Traverse(ray, FLT_MAX, [&](unsigned int meshIndex, float tMax) {
+            const gps::Mesh* mesh = meshes[meshIndex];
+            return triangleBvhs[meshIndex].Traverse(localRay, tMax, [&](unsigned int triangle, float triangleMax) {
+                float t = IntersectRayTriangle(localRay,
+                    mesh->vertices[mesh->indices[3 * triangle + 0]].Position,
+                    mesh->vertices[mesh->indices[3 * triangle + 1]].Position,
+                    mesh->vertices[mesh->indices[3 * triangle + 2]].Position);
+                if (t > 0.0f && t < triangleMax) {
+                    hit.mesh = (int)meshIndex;
+                    hit.triangle = (int)triangle;
+                    return t;
+                }
+                return triangleMax;
+            });
+        });
+
+        hit.distance = closest;
+        return hit.mesh != -1;
+    }
+
+    void SceneBvh::Benchmark(gps::Model3D& model, glm::mat4 modelMatrix) {
+        const int BUILD_RUNS = 5;
+        const int FRUSTUM_QUERIES = 10000;
+        const int RAY_QUERIES = 100000;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BUILD_RUNS; i++)
+            Build(model, modelMatrix);
+        double buildMs = ElapsedMs(start) / BUILD_RUNS;
+
+        size_t triangleNodes = 0;
+        for (size_t i = 0; i < triangleBvhs.size(); i++)
+            triangleNodes += triangleBvhs[i].getNodes().size();
+
+        // cameras scattered over the scene, looking in random directions
+        BoundingBox sceneBox;
+        sceneBox.min = meshBvh.isEmpty() ? glm::vec3(0.0f) : meshBvh.getNodes()[0].min;
+        sceneBox.max = meshBvh.isEmpty() ? glm::vec3(0.0f) : meshBvh.getNodes()[0].max;
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+
+        std::vector<unsigned int> visible;
+        size_t visibleTotal = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FRUSTUM_QUERIES; i++) {
+            glm::vec3 eye = glm::mix(sceneBox.min, sceneBox.max, glm::vec3(unit(random), unit(random), unit(random)));
+            float yaw = unit(random) * 6.2831853f;
+            glm::vec3 front(std::cos(yaw), unit(random) - 0.5f, std::sin(yaw));
+            gps::Frustum frustum;
+            frustum.extract(projection * glm::lookAt(eye, eye + front, glm::vec3(0.0f, 1.0f, 0.0f)));
+            visible.clear();
+            QueryFrustum(frustum, visible);
+            visibleTotal += visible.size();
+        }
+        double frustumMs = ElapsedMs(start);
+
+        int hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RAY_QUERIES; i++) {
+            Ray ray;
+            ray.origin = glm::mix(sceneBox.min, sceneBox.max, glm::vec3(unit(random), unit(random), unit(random)));
+            ray.direction = glm::normalize(glm::vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f) + glm::vec3(0.0f, 1e-4f, 0.0f));
+            RayHit hit;
+            if (Raycast(ray, hit))
+                hits++;
+        }
+        double rayMs = ElapsedMs(start);
+
+        std::cout << "BVH benchmark" << std::endl;
+        std::cout << "  meshes          : " << meshes.size() << " (" << meshBvh.getNodes().size() << " nodes, "
+            << triangleNodes << " triangle nodes)" << std::endl;
+        std::cout << "  build           : " << buildMs << " ms" << std::endl;
+        std::cout << "  frustum queries : " << FRUSTUM_QUERIES / (frustumMs / 1000.0) << " /s, "
+            << (double)visibleTotal / FRUSTUM_QUERIES << " meshes visible on average" << std::endl;
+        std::cout << "  ray queries     : " << RAY_QUERIES / (rayMs / 1000.0) / 1e6 << " Mrays/s, "
+            << hits << " hits" << std::endl;
+    }
+}
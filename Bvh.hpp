@@ -0,0 +1,144 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+#include "Model3D.hpp"
+#include "Frustum.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace gps {
+
+    // 32 byte node, the two children of an interior node are stored next to each other
+    struct BvhNode {
+        glm::vec3 min;
+        // interior: index of the left child, leaf: first entry in the primitive index list
+        unsigned int leftFirst;
+        glm::vec3 max;
+        // 0 for interior nodes
+        unsigned int count;
+    };
+
+    struct Ray {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct RayHit {
+        int mesh = -1;
+        int triangle = -1;
+        float distance = 0.0f;
+    };
+
+    // Bounding volume hierarchy over a set of boxes, built with binned SAH
+    class Bvh
+    {
+    public:
+        // boxes are copied, primitive i of the queries is boxes[i]
+        void Build(const std::vector<BoundingBox>& boxes);
+
+        // appends the primitives whose box intersects the frustum
+        void QueryFrustum(const gps::Frustum& frustum, std::vector<unsigned int>& result) const;
+
+        // calls hit(primitive, tMax) for every leaf primitive whose box the ray enters before tMax,
+        // hit returns the new tMax (closest hit so far)
+        template <typename HitFunction>
+        float Traverse(const Ray& ray, float tMax, HitFunction hit) const;
+
+        const std::vector<BvhNode>& getNodes() const;
+        bool isEmpty() const;
+
+    private:
+        std::vector<BvhNode> nodes;
+        std::vector<unsigned int> primitiveIndices;
+        std::vector<BoundingBox> boxes;
+        std::vector<glm::vec3> centroids;
+
+        void Subdivide(unsigned int nodeIndex, int depth, std::atomic<unsigned int>& nodesUsed);
+        void UpdateBounds(unsigned int nodeIndex);
+        float FindBestSplit(const BvhNode& node, int& axis, float& splitPosition) const;
+        void QueryFrustum(unsigned int nodeIndex, const gps::Frustum& frustum, bool inside, std::vector<unsigned int>& result) const;
+    };
+
+    // Two level BVH: one over the meshes of a model and one over the triangles of each mesh
+    class SceneBvh
+    {
+    public:
+        void Build(gps::Model3D& model, glm::mat4 modelMatrix);
+
+        // indices of the meshes intersecting the frustum
+        void QueryFrustum(const gps::Frustum& frustum, std::vector<unsigned int>& meshes) const;
+        // closest triangle hit along the ray, false if nothing is hit
+        bool Raycast(const Ray& ray, RayHit& hit) const;
+
+        // prints build time and query throughput for this model
+        void Benchmark(gps::Model3D& model, glm::mat4 modelMatrix);
+
+    private:
+        glm::mat4 modelMatrix;
+        glm::mat4 inverseModelMatrix;
+        std::vector<const gps::Mesh*> meshes;
+        gps::Bvh meshBvh;
+        // object space triangle hierarchies, one per mesh
+        std::vector<gps::Bvh> triangleBvhs;
+    };
+
+    // Ray/box slab test, returns the entry distance or a negative value on a miss
+    inline float IntersectRayBox(const Ray& ray, const glm::vec3& inverseDirection, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax)
+    {
+        glm::vec3 t1 = (boxMin - ray.origin) * inverseDirection;
+        glm::vec3 t2 = (boxMax - ray.origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t1, t2);
+        glm::vec3 tFar = glm::max(t1, t2);
+        float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+        float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+        return enter <= exit ? enter : -1.0f;
+    }
+
+    template <typename HitFunction>
+    float Bvh::Traverse(const Ray& ray, float tMax, HitFunction hit) const
+    {
+        if (nodes.empty())
+            return tMax;
+
+        glm::vec3 inverseDirection = 1.0f / ray.direction;
+        unsigned int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+            if (IntersectRayBox(ray, inverseDirection, node.min, node.max, tMax) < 0.0f)
+                continue;
+
+            if (node.count > 0) {
+                for (unsigned int i = 0; i < node.count; i++)
+                    tMax = hit(primitiveIndices[node.leftFirst + i], tMax);
+                continue;
+            }
+
+            // visit the nearer child first
+            const BvhNode& left = nodes[node.leftFirst];
+            const BvhNode& right = nodes[node.leftFirst + 1];
+            float leftDistance = IntersectRayBox(ray, inverseDirection, left.min, left.max, tMax);
+            float rightDistance = IntersectRayBox(ray, inverseDirection, right.min, right.max, tMax);
+            if (leftDistance >= 0.0f && rightDistance >= 0.0f) {
+                bool leftFirst = leftDistance <= rightDistance;
+                stack[stackSize++] = node.leftFirst + (leftFirst ? 1 : 0);
+                stack[stackSize++] = node.leftFirst + (leftFirst ? 0 : 1);
+            }
+            else if (leftDistance >= 0.0f) {
+                stack[stackSize++] = node.leftFirst;
+            }
+            else if (rightDistance >= 0.0f) {
+                stack[stackSize++] = node.leftFirst + 1;
+            }
+        }
+        return tMax;
+    }
+}
+
+#endif /* Bvh_hpp */
@@ -20,6 +20,15 @@ namespace gps {
         return glm::lookAt(cameraPosition, cameraTarget, cameraUpDirection);
     }
 
+    glm::mat4 Camera::getViewMatrix(glm::vec3 position, float pitch, float yaw) {
+        //same directions as rotate()
+        glm::mat4 eulerAngle = glm::yawPitchRoll(glm::radians(yaw), glm::radians(pitch), 0.0f);
+        glm::vec3 front = glm::vec3(glm::normalize((eulerAngle * glm::vec4(originalFront, 0.0f))));
+        glm::vec3 right = glm::normalize(glm::cross(front, originalUp));
+        glm::vec3 up = glm::cross(right, front);
+        return glm::lookAt(position, position + front, up);
+    }
+
     //update the camera internal parameters following a camera move event
     void Camera::move(MOVE_DIRECTION direction, float speed) {
         //TODO
@@ -53,6 +62,16 @@ namespace gps {
         cameraUpDirection = glm::cross(cameraRightDirection, cameraFrontDirection);
         cameraTarget = cameraPosition + cameraFrontDirection;
     }
+    glm::vec3 Camera::getPosition()
+    {
+        return cameraPosition;
+    }
+
+    glm::vec3 Camera::getFrontDirection()
+    {
+        return cameraFrontDirection;
+    }
+
     void Camera::pposition()
     {
         printf("X: %f y: %f z: %f\n", cameraPosition.x, cameraPosition.y, cameraPosition.z);
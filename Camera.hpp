@@ -18,6 +18,8 @@ namespace gps {
         Camera(glm::vec3 cameraPosition, glm::vec3 cameraTarget, glm::vec3 cameraUp);
         //return the view matrix, using the glm::lookAt() function
         glm::mat4 getViewMatrix();
+        //view matrix at another position and rotation (e.g. between two simulation steps), the camera is not changed
+        glm::mat4 getViewMatrix(glm::vec3 position, float pitch, float yaw);
         //update the camera internal parameters following a camera move event
         void move(MOVE_DIRECTION direction, float speed);
         //update the camera internal parameters following a camera rotate event
@@ -25,6 +27,8 @@ namespace gps {
         //pitch - camera rotation around the x axis
         void rotate(float pitch, float yaw);
         void pposition();
+        glm::vec3 getPosition();
+        glm::vec3 getFrontDirection();
         
     private:
         glm::vec3 cameraPosition;
@@ -0,0 +1,248 @@
+#include "ClusteredLights.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CLUSTER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLUSTER_SSE
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+        // replaces the storage of a buffer texture's buffer, a zero sized buffer can not back a texture
+        void UploadBuffer(GLuint buffer, const void* data, size_t bytes) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), NULL, GL_STREAM_DRAW);
+            if (bytes > 0)
+                glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        }
+
+        void CreateBufferTexture(GLuint& buffer, GLuint& texture, GLenum format) {
+            glGenBuffers(1, &buffer);
+            UploadBuffer(buffer, NULL, 0);
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+    }
+
+    void ClusteredLights::Init() {
+        CreateBufferTexture(lightBuffer, lightTexture, GL_RGBA32F);
+        CreateBufferTexture(gridBuffer, gridTexture, GL_RG32UI);
+        CreateBufferTexture(indexBuffer, indexTexture, GL_R32UI);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLights::Delete() {
+        GLuint textures[] = { lightTexture, gridTexture, indexTexture };
+        GLuint buffers[] = { lightBuffer, gridBuffer, indexBuffer };
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+        lightTexture = gridTexture = indexTexture = 0;
+        lightBuffer = gridBuffer = indexBuffer = 0;
+    }
+
+    void ClusteredLights::setProjection(float fovY, float aspect, float nearPlane, float farPlane) {
+        if (fovY == this->fovY && aspect == this->aspect && nearPlane == this->nearPlane && farPlane == this->farPlane)
+            return;
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+
+        float tanHalfY = std::tan(fovY * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+        clusterMin.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+        clusterMax.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+
+        for (int z = 0; z < CLUSTERS_Z; z++) {
+            float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / CLUSTERS_Z);
+            float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / CLUSTERS_Z);
+            for (int y = 0; y < CLUSTERS_Y; y++) {
+                float bottom = -1.0f + 2.0f * y / CLUSTERS_Y;
+                float top = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y;
+                for (int x = 0; x < CLUSTERS_X; x++) {
+                    float left = -1.0f + 2.0f * x / CLUSTERS_X;
+                    float right = -1.0f + 2.0f * (x + 1) / CLUSTERS_X;
+
+                    // the tile's edges spread with depth, the box has to hold both ends of the slice
+                    float xs[4] = { left * sliceNear, left * sliceFar, right * sliceNear, right * sliceFar };
+                    float ys[4] = { bottom * sliceNear, bottom * sliceFar, top * sliceNear, top * sliceFar };
+                    size_t cluster = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+                    clusterMin[cluster] = glm::vec3(*std::min_element(xs, xs + 4) * tanHalfX, *std::min_element(ys, ys + 4) * tanHalfY, -sliceFar);
+                    clusterMax[cluster] = glm::vec3(*std::max_element(xs, xs + 4) * tanHalfX, *std::max_element(ys, ys + 4) * tanHalfY, -sliceNear);
+                }
+            }
+        }
+    }
+
+    int ClusteredLights::getSlice(float depth) const {
+        return (int)std::floor(std::log(depth / nearPlane) * CLUSTERS_Z / std::log(farPlane / nearPlane));
+    }
+
+    void ClusteredLights::Build(const std::vector<gps::PointLight>& lights, const glm::mat4& view) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        eyeLights.resize(lights.size());
+        firstSlice.resize(lights.size());
+        lastSlice.resize(lights.size());
+        lightData.resize(lights.size() * 2);
+        visibleLights = 0;
+
+        for (size_t i = 0; i < lights.size(); i++) {
+            glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float radius = lights[i].radius;
+            float depth = -position.z;
+            eyeLights[i] = glm::vec4(position, radius);
+            lightData[2 * i] = eyeLights[i];
+            lightData[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+
+            if (depth + radius < nearPlane || depth - radius > farPlane) {
+                firstSlice[i] = 1;
+                lastSlice[i] = 0;
+                continue;
+            }
+            firstSlice[i] = std::max(getSlice(std::max(depth - radius, nearPlane)), 0);
+            lastSlice[i] = std::min(getSlice(std::min(depth + radius, farPlane)), CLUSTERS_Z - 1);
+            visibleLights++;
+        }
+
+        grid.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z * 2);
+        indices.clear();
+        for (int z = 0; z < CLUSTERS_Z; z++) {
+            // only the lights reaching into this slice are tested against its clusters
+            sliceX.clear(); sliceY.clear(); sliceZ.clear(); sliceRadius2.clear();
+            sliceLights.clear();
+            for (size_t i = 0; i < lights.size(); i++) {
+                if (z < firstSlice[i] || z > lastSlice[i])
+                    continue;
+                sliceX.push_back(eyeLights[i].x);
+                sliceY.push_back(eyeLights[i].y);
+                sliceZ.push_back(eyeLights[i].z);
+                sliceRadius2.push_back(eyeLights[i].w * eyeLights[i].w);
+                sliceLights.push_back((unsigned int)i);
+            }
+
+            for (int cluster = z * CLUSTERS_X * CLUSTERS_Y; cluster < (z + 1) * CLUSTERS_X * CLUSTERS_Y; cluster++) {
+                grid[2 * cluster] = (unsigned int)indices.size();
+                BinCluster(clusterMin[cluster], clusterMax[cluster]);
+                grid[2 * cluster + 1] = (unsigned int)indices.size() - grid[2 * cluster];
+            }
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        buildMilliseconds = elapsed.count();
+    }
+
+    void ClusteredLights::BinCluster(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+        size_t count = sliceLights.size();
+        size_t i = 0;
+
+        // squared distance from the light to the box, the per axis distance is zero inside the box
+#if defined(CLUSTER_AVX)
+        // 8 lights per iteration
+        __m256 minX = _mm256_set1_ps(boxMin.x), minY = _mm256_set1_ps(boxMin.y), minZ = _mm256_set1_ps(boxMin.z);
+        __m256 maxX = _mm256_set1_ps(boxMax.x), maxY = _mm256_set1_ps(boxMax.y), maxZ = _mm256_set1_ps(boxMax.z);
+        __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(&sliceX[i]);
+            __m256 y = _mm256_loadu_ps(&sliceY[i]);
+            __m256 z = _mm256_loadu_ps(&sliceZ[i]);
+            __m256 dx = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(minX, x), zero), _mm256_max_ps(_mm256_sub_ps(x, maxX), zero));
+            __m256 dy = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(minY, y), zero), _mm256_max_ps(_mm256_sub_ps(y, maxY), zero));
+            __m256 dz = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(minZ, z), zero), _mm256_max_ps(_mm256_sub_ps(z, maxZ), zero));
+            __m256 distance2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(distance2, _mm256_loadu_ps(&sliceRadius2[i]), _CMP_LE_OQ));
+            for (int k = 0; k < 8; k++) {
+                if ((mask >> k) & 1)
+                    indices.push_back(sliceLights[i + k]);
+            }
+        }
+#elif defined(CLUSTER_SSE)
+        // 4 lights per iteration
+        __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+        __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+        __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(&sliceX[i]);
+            __m128 y = _mm_loadu_ps(&sliceY[i]);
+            __m128 z = _mm_loadu_ps(&sliceZ[i]);
+            __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minX, x), zero), _mm_max_ps(_mm_sub_ps(x, maxX), zero));
+            __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minY, y), zero), _mm_max_ps(_mm_sub_ps(y, maxY), zero));
+            __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(minZ, z), zero), _mm_max_ps(_mm_sub_ps(z, maxZ), zero));
+            __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_loadu_ps(&sliceRadius2[i])));
+            for (int k = 0; k < 4; k++) {
+                if ((mask >> k) & 1)
+                    indices.push_back(sliceLights[i + k]);
+            }
+        }
+#endif
+
+        // remaining lights (or everything without SIMD)
+        for (; i < count; i++) {
+            float dx = std::max(boxMin.x - sliceX[i], 0.0f) + std::max(sliceX[i] - boxMax.x, 0.0f);
+            float dy = std::max(boxMin.y - sliceY[i], 0.0f) + std::max(sliceY[i] - boxMax.y, 0.0f);
+            float dz = std::max(boxMin.z - sliceZ[i], 0.0f) + std::max(sliceZ[i] - boxMax.z, 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= sliceRadius2[i])
+                indices.push_back(sliceLights[i]);
+        }
+    }
+
+    void ClusteredLights::Upload() {
+        UploadBuffer(lightBuffer, lightData.empty() ? NULL : &lightData[0], lightData.size() * sizeof(glm::vec4));
+        UploadBuffer(gridBuffer, grid.empty() ? NULL : &grid[0], grid.size() * sizeof(unsigned int));
+        UploadBuffer(indexBuffer, indices.empty() ? NULL : &indices[0], indices.size() * sizeof(unsigned int));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLights::BindTextures() const {
+        GLuint textures[] = { lightTexture, gridTexture, indexTexture };
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void ClusteredLights::setUniforms(GLuint program, int width, int height) const {
+        // the program has to be in use
+        glUniform1i(glGetUniformLocation(program, "pointLights"), FIRST_TEXTURE_UNIT);
+        glUniform1i(glGetUniformLocation(program, "lightGrid"), FIRST_TEXTURE_UNIT + 1);
+        glUniform1i(glGetUniformLocation(program, "lightIndices"), FIRST_TEXTURE_UNIT + 2);
+        glUniform2f(glGetUniformLocation(program, "clusterTileSize"), (float)width / CLUSTERS_X, (float)height / CLUSTERS_Y);
+        // slice = log(depth) * scale - bias, the inverse of the slice depths in setProjection
+        float scale = CLUSTERS_Z / std::log(farPlane / nearPlane);
+        glUniform2f(glGetUniformLocation(program, "clusterDepth"), scale, scale * std::log(nearPlane));
+        glUniform3i(glGetUniformLocation(program, "clusterCount"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    }
+
+    size_t ClusteredLights::getVisibleLightCount() const {
+        return visibleLights;
+    }
+
+    size_t ClusteredLights::getIndexCount() const {
+        return indices.size();
+    }
+
+    double ClusteredLights::getBuildMilliseconds() const {
+        return buildMilliseconds;
+    }
+
+    const std::vector<unsigned int>& ClusteredLights::getGrid() const {
+        return grid;
+    }
+
+    const std::vector<unsigned int>& ClusteredLights::getIndices() const {
+        return indices;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef ClusteredLights_hpp
+#define ClusteredLights_hpp
+
+#include <GL/glew.h>
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct PointLight {
+        // world space
+        glm::vec3 position;
+        // the light falls off to zero at this distance
+        float radius;
+        glm::vec3 color;
+    };
+
+    // Clustered forward lighting: the view frustum is split into CLUSTERS_X * CLUSTERS_Y screen tiles
+    // and CLUSTERS_Z exponential depth slices. Every frame the lights are binned on the CPU (sphere
+    // against cluster box, 4 or 8 lights at a time) and the lights, the offset/count of every cluster
+    // and the light index lists are uploaded to buffer textures read by basic.frag (POINT_LIGHTS).
+    class ClusteredLights
+    {
+    public:
+        static const int CLUSTERS_X = 16;
+        static const int CLUSTERS_Y = 9;
+        static const int CLUSTERS_Z = 24;
+
+        // creates the buffers, needs a GL context
+        void Init();
+        void Delete();
+
+        // view space boxes of the clusters, only recomputed when the projection changes
+        void setProjection(float fovY, float aspect, float nearPlane, float farPlane);
+
+        // bins the lights into the clusters seen through view, Upload sends the result to the GPU
+        void Build(const std::vector<gps::PointLight>& lights, const glm::mat4& view);
+        void Upload();
+
+        // binds the buffer textures (units FIRST_TEXTURE_UNIT and up) for the draws that follow
+        void BindTextures() const;
+        // sets the samplers and cluster parameters of a POINT_LIGHTS program, for a framebuffer of width x height
+        void setUniforms(GLuint program, int width, int height) const;
+
+        // lights inside the view, and references to them summed over all clusters
+        size_t getVisibleLightCount() const;
+        size_t getIndexCount() const;
+        // CPU time of the last Build call
+        double getBuildMilliseconds() const;
+
+        // the lights of a cluster, (offset, count) into getIndices
+        const std::vector<unsigned int>& getGrid() const;
+        const std::vector<unsigned int>& getIndices() const;
+
+    private:
+        // past the textures meshes bind from unit 0
+        static const int FIRST_TEXTURE_UNIT = 8;
+
+        float fovY = 0.0f;
+        float aspect = 0.0f;
+        float nearPlane = 0.0f;
+        float farPlane = 0.0f;
+        std::vector<glm::vec3> clusterMin;
+        std::vector<glm::vec3> clusterMax;
+
+        // eye space lights overlapping the current depth slice, as arrays for the SIMD test
+        std::vector<float> sliceX, sliceY, sliceZ, sliceRadius2;
+        std::vector<unsigned int> sliceLights;
+        // eye space position and radius, first and last depth slice of every light
+        std::vector<glm::vec4> eyeLights;
+        std::vector<int> firstSlice, lastSlice;
+
+        // two texels per light: eye position and radius, color
+        std::vector<glm::vec4> lightData;
+        std::vector<unsigned int> grid;
+        std::vector<unsigned int> indices;
+        size_t visibleLights = 0;
+        double buildMilliseconds = 0.0;
+
+        GLuint lightBuffer = 0, lightTexture = 0;
+        GLuint gridBuffer = 0, gridTexture = 0;
+        GLuint indexBuffer = 0, indexTexture = 0;
+
+        // depth slice holding an eye space distance, may be out of range
+        int getSlice(float depth) const;
+        // appends the slice lights touching the box to indices
+        void BinCluster(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    };
+}
+
+#endif /* ClusteredLights_hpp */
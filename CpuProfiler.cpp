@@ -0,0 +1,164 @@
+#include "CpuProfiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    std::atomic<unsigned int> CpuProfiler::state(0);
+
+    namespace {
+        // scopes one thread can record in a capture, the rest is dropped
+        const size_t EVENT_CAPACITY = 1 << 16;
+
+        struct Event {
+            const char* name;
+            long long begin;
+            long long end;
+        };
+
+        // Only its thread writes to it, the trace reads it once the capture has stopped.
+        // The first scope of a capture moves captureStart and clears dropped, then publishes the
+        // capture's state value in capture. A thread that saw the capturing state just before it
+        // ended records into the old capture, the trace of the next one skips that buffer.
+        struct ThreadBuffer {
+            std::vector<Event> events;
+            std::atomic<size_t> count;
+            std::atomic<size_t> captureStart;
+            std::atomic<size_t> dropped;
+            // state value of the capture the buffer last recorded in, 0 before the first one
+            std::atomic<unsigned int> capture;
+            int id;
+            // set by its thread whenever, read by the trace
+            std::atomic<const char*> name;
+        };
+
+        // buffers live as long as the program, threads may record until it exits
+        std::mutex mutex;
+        std::vector<ThreadBuffer*> buffers;
+        thread_local ThreadBuffer* threadBuffer = NULL;
+
+        int remainingFrames = 0;
+        // state value of the running or last capture
+        unsigned int traceCapture = 0;
+        std::string traceFile;
+        long long captureBegin = 0;
+
+        ThreadBuffer* getThreadBuffer() {
+            if (threadBuffer != NULL)
+                return threadBuffer;
+            // the events are allocated by the first scope, threads that never record do not pay for them
+            ThreadBuffer* buffer = new ThreadBuffer();
+            buffer->count = 0;
+            buffer->captureStart = 0;
+            buffer->dropped = 0;
+            buffer->capture = 0;
+            buffer->name = NULL;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            buffer->id = (int)buffers.size() + 1;
+            buffers.push_back(buffer);
+            threadBuffer = buffer;
+            return buffer;
+        }
+    }
+
+    void CpuProfiler::StartCapture(int frameCount, const std::string& fileName) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (isCapturing() || frameCount <= 0)
+            return;
+        remainingFrames = frameCount;
+        traceFile = fileName;
+        captureBegin = Now();
+        traceCapture = state.load(std::memory_order_relaxed) + 1;
+        state.store(traceCapture, std::memory_order_release);
+        std::cout << "CPU trace: capturing " << frameCount << " frames" << std::endl;
+    }
+
+    void CpuProfiler::EndFrame() {
+        if (!isCapturing())
+            return;
+        // the lock is kept while writing, so no new capture starts before the trace is out
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remainingFrames > 0)
+            return;
+        state.store(traceCapture + 1, std::memory_order_release);
+        WriteTrace();
+    }
+
+    void CpuProfiler::setThreadName(const char* name) {
+        getThreadBuffer()->name.store(name, std::memory_order_relaxed);
+    }
+
+    void CpuProfiler::Record(const char* name, long long begin, long long end) {
+        // the scope may end after the capture
+        unsigned int capture = state.load(std::memory_order_acquire);
+        if ((capture & 1) == 0)
+            return;
+        ThreadBuffer* buffer = getThreadBuffer();
+        if (buffer->events.empty())
+            buffer->events.resize(EVENT_CAPACITY);
+        size_t index = buffer->count.load(std::memory_order_relaxed);
+        if (buffer->capture.load(std::memory_order_relaxed) != capture) {
+            // first scope of this thread in the capture
+            buffer->captureStart.store(index, std::memory_order_relaxed);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+            buffer->capture.store(capture, std::memory_order_release);
+        }
+        if (index - buffer->captureStart.load(std::memory_order_relaxed) >= EVENT_CAPACITY) {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Event& event = buffer->events[index % EVENT_CAPACITY];
+        event.name = name;
+        event.begin = begin;
+        event.end = end;
+        buffer->count.store(index + 1, std::memory_order_release);
+    }
+
+    void CpuProfiler::WriteTrace() {
+        std::ofstream file(traceFile.c_str());
+        if (!file) {
+            std::cout << "ERROR: could not write the CPU trace to " << traceFile << std::endl;
+            return;
+        }
+
+        // complete events ("X") in microseconds from the start of the capture
+        file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        size_t eventCount = 0, dropped = 0;
+        for (size_t b = 0; b < buffers.size(); b++) {
+            ThreadBuffer& buffer = *buffers[b];
+            const char* name = buffer.name.load(std::memory_order_relaxed);
+            if (name != NULL) {
+                file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id
+                    << ",\"args\":{\"name\":\"" << name << "\"}}";
+                first = false;
+            }
+            // threads that recorded nothing in this capture
+            if (buffer.capture.load(std::memory_order_acquire) != traceCapture)
+                continue;
+            size_t start = buffer.captureStart.load(std::memory_order_relaxed);
+            size_t end = buffer.count.load(std::memory_order_acquire);
+            for (size_t i = start; i < end; i++) {
+                const Event& event = buffer.events[i % EVENT_CAPACITY];
+                // scopes begun before the capture are cut at its start
+                long long begin = event.begin > captureBegin ? event.begin : captureBegin;
+                file << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+                    << ",\"ts\":" << (begin - captureBegin) / 1000.0 << ",\"dur\":" << (event.end - begin) / 1000.0 << "}";
+                first = false;
+            }
+            eventCount += end - start;
+            dropped += buffer.dropped.load(std::memory_order_relaxed);
+        }
+        file << "\n]}\n";
+
+        std::cout << "CPU trace: " << eventCount << " scopes on " << buffers.size() << " threads written to " << traceFile;
+        if (dropped > 0)
+            std::cout << ", " << dropped << " dropped";
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,157 @@
+#include "DrawList.hpp"
+#include "CpuProfiler.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+namespace gps {
+
+    void DrawList::Build(const std::vector<gps::SceneInstance>& instances, const gps::Frustum& frustum,
+        gps::CullStats& stats, gps::JobSystem& jobs, const gps::OcclusionCuller* occlusion, const gps::LodSettings* lod)
+    {
+        CPU_SCOPE("DrawList::Build");
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        // every mesh of every instance becomes one work item
+        firstMesh.resize(instances.size() + 1);
+        firstMesh[0] = 0;
+        for (size_t i = 0; i < instances.size(); i++)
+            firstMesh[i + 1] = firstMesh[i] + instances[i].model->getMeshes().size();
+        size_t meshCount = firstMesh.back();
+
+        size_t chunkCount = (meshCount + MESHES_PER_JOB - 1) / MESHES_PER_JOB;
+        if (chunks.size() < chunkCount)
+            chunks.resize(chunkCount);
+
+        jobs.ParallelFor(meshCount, MESHES_PER_JOB, [&](size_t begin, size_t end) {
+            BuildChunk(chunks[begin / MESHES_PER_JOB], begin, end, instances, frustum, occlusion, lod);
+        });
+
+        packets.clear();
+        for (size_t i = 0; i < chunkCount; i++) {
+            packets.insert(packets.end(), chunks[i].packets.begin(), chunks[i].packets.end());
+            stats.visible += chunks[i].stats.visible;
+            stats.culled += chunks[i].stats.culled;
+            stats.occluded += chunks[i].stats.occluded;
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        buildMilliseconds = elapsed.count();
+    }
+
+    void DrawList::BuildChunk(Chunk& chunk, size_t begin, size_t end, const std::vector<gps::SceneInstance>& instances,
+        const gps::Frustum& frustum, const gps::OcclusionCuller* occlusion, const gps::LodSettings* lod)
+    {
+        CPU_SCOPE("DrawList::BuildChunk");
+        chunk.packets.clear();
+        chunk.boxes.clear();
+        chunk.stats.reset();
+
+        // instance owning the first mesh of the range
+        size_t first = std::upper_bound(firstMesh.begin(), firstMesh.end(), begin) - firstMesh.begin() - 1;
+
+        size_t instance = first;
+        for (size_t i = begin; i < end; i++) {
+            while (i >= firstMesh[instance + 1])
+                instance++;
+            const gps::Mesh& mesh = instances[instance].model->getMeshes()[i - firstMesh[instance]];
+            chunk.boxes.push(mesh.bounds, instances[instance].modelMatrix);
+        }
+
+        frustum.cullBoxes(chunk.boxes, chunk.visible);
+        for (size_t i = 0; i < chunk.visible.size(); i++) {
+            if (!chunk.visible[i])
+                chunk.stats.culled++;
+        }
+        if (occlusion != NULL)
+            occlusion->cullBoxes(chunk.boxes, chunk.visible, chunk.stats);
+
+        instance = first;
+        for (size_t i = begin; i < end; i++) {
+            while (i >= firstMesh[instance + 1])
+                instance++;
+            if (!chunk.visible[i - begin])
+                continue;
+
+            const glm::mat4& modelMatrix = instances[instance].modelMatrix;
+            gps::DrawPacket packet;
+            packet.mesh = &instances[instance].model->getMeshes()[i - firstMesh[instance]];
+            packet.lod = lod != NULL ? packet.mesh->SelectLod(*lod, modelMatrix) : 0;
+            packet.modelMatrix = modelMatrix;
+            packet.normalMatrix = instances[instance].normalMatrix;
+            chunk.packets.push_back(packet);
+            chunk.stats.visible++;
+        }
+    }
+
+    void DrawList::Submit(gps::Shader shader, const glm::mat4& view, unsigned int features) const {
+        CPU_SCOPE("DrawList::Submit");
+        // the view is a rigid transform, so its inverse transpose is the view itself
+        glm::mat3 viewRotation = glm::mat3(view);
+        bool alphaTested = false;
+        for (size_t i = 0; i < packets.size() && !alphaTested; i++)
+            alphaTested = (packets[i].mesh->getShaderFeatures() & gps::SHADER_ALPHA_TEST) != 0;
+        GLboolean depthWrites = GL_TRUE;
+        if (alphaTested)
+            glGetBooleanv(GL_DEPTH_WRITEMASK, &depthWrites);
+
+        GLuint currentProgram = 0;
+        GLint modelLoc = -1;
+        GLint normalMatrixLoc = -1;
+        // opaque meshes first, then the alpha tested ones
+        for (int pass = 0; pass < (alphaTested ? 2 : 1); pass++) {
+            if (pass == 1)
+                glDepthMask(GL_TRUE);
+
+            for (size_t i = 0; i < packets.size(); i++) {
+                unsigned int meshFeatures = packets[i].mesh->getShaderFeatures();
+                if (((meshFeatures & gps::SHADER_ALPHA_TEST) != 0) != (pass == 1))
+                    continue;
+
+                shader.shaderProgram = shader.getVariant(features | meshFeatures);
+                if (shader.shaderProgram != currentProgram) {
+                    shader.useShaderProgram();
+                    modelLoc = glGetUniformLocation(shader.shaderProgram, "model");
+                    normalMatrixLoc = glGetUniformLocation(shader.shaderProgram, "normalMatrix");
+                    currentProgram = shader.shaderProgram;
+                }
+
+                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packets[i].modelMatrix));
+                glm::mat3 normalMatrix = viewRotation * packets[i].normalMatrix;
+                glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                packets[i].mesh->Draw(shader, packets[i].lod);
+            }
+        }
+
+        if (alphaTested)
+            glDepthMask(depthWrites);
+    }
+
+    void DrawList::SubmitDepth(gps::Shader shader) const {
+        shader.useShaderProgram();
+        GLint modelLoc = glGetUniformLocation(shader.shaderProgram, "model");
+
+        for (size_t i = 0; i < packets.size(); i++) {
+            // the position-only stream can not alpha test, Submit draws these with depth writes
+            if (packets[i].mesh->getShaderFeatures() & gps::SHADER_ALPHA_TEST)
+                continue;
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(packets[i].modelMatrix));
+            packets[i].mesh->DrawDepth(shader, packets[i].lod);
+        }
+    }
+
+    void DrawList::PrepareShader(gps::Shader shader, unsigned int features) const {
+        for (size_t i = 0; i < packets.size(); i++)
+            shader.getVariant(features | packets[i].mesh->getShaderFeatures());
+    }
+
+    const std::vector<gps::DrawPacket>& DrawList::getPackets() const {
+        return packets;
+    }
+
+    double DrawList::getBuildMilliseconds() const {
+        return buildMilliseconds;
+    }
+}
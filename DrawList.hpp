@@ -0,0 +1,78 @@
+#ifndef DrawList_hpp
+#define DrawList_hpp
+
+#include "glm/glm.hpp"
+
+#include "Model3D.hpp"
+#include "Frustum.hpp"
+#include "OcclusionCuller.hpp"
+#include "JobSystem.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // A model placed in the scene for the current frame
+    struct SceneInstance {
+        gps::Model3D* model;
+        glm::mat4 modelMatrix;
+        // inverse transpose of the upper 3x3 of modelMatrix
+        glm::mat3 normalMatrix;
+    };
+
+    // Everything the GL thread needs to draw one mesh
+    struct DrawPacket {
+        gps::Mesh* mesh;
+        int lod;
+        glm::mat4 modelMatrix;
+        // inverse transpose of the model matrix, Submit turns it to eye space with the view it draws with
+        glm::mat3 normalMatrix;
+    };
+
+    // Flat list of draw packets for one frame. Building it (culling, LOD selection and the
+    // matrices) runs on the job system, playing it back is the only part that calls GL.
+    class DrawList
+    {
+    public:
+        // Fills the list with the visible meshes of all instances, in instance order, and counts them in stats.
+        // A model may appear only once, its meshes remember the level picked last time (LOD hysteresis).
+        void Build(const std::vector<gps::SceneInstance>& instances, const gps::Frustum& frustum,
+            gps::CullStats& stats, gps::JobSystem& jobs, const gps::OcclusionCuller* occlusion = NULL, const gps::LodSettings* lod = NULL);
+
+        // GL thread only. Every packet uses the shader variant for features plus its material's (SHADER_*).
+        // Alpha tested meshes are left out of the depth pass and drawn last, with depth writes on.
+        // view is the one the frame's uniforms were set with, it may differ from the one culled with (late latching).
+        void Submit(gps::Shader shader, const glm::mat4& view, unsigned int features = 0) const;
+        void SubmitDepth(gps::Shader shader) const;
+        // compiles the variants Submit is going to use
+        void PrepareShader(gps::Shader shader, unsigned int features) const;
+
+        const std::vector<gps::DrawPacket>& getPackets() const;
+        // CPU time of the last Build call
+        double getBuildMilliseconds() const;
+
+    private:
+        // output of one job, merged in order once all jobs are done
+        struct Chunk {
+            std::vector<gps::DrawPacket> packets;
+            gps::BoxList boxes;
+            std::vector<unsigned char> visible;
+            gps::CullStats stats;
+        };
+
+        // meshes handed to a job at once
+        static const size_t MESHES_PER_JOB = 32;
+
+        std::vector<gps::DrawPacket> packets;
+        std::vector<Chunk> chunks;
+        // index of the first mesh of every instance in the flattened mesh list, plus the total
+        std::vector<size_t> firstMesh;
+        double buildMilliseconds = 0.0;
+
+        void BuildChunk(Chunk& chunk, size_t begin, size_t end, const std::vector<gps::SceneInstance>& instances,
+            const gps::Frustum& frustum, const gps::OcclusionCuller* occlusion, const gps::LodSettings* lod);
+    };
+}
+
+#endif /* DrawList_hpp */
@@ -0,0 +1,124 @@
+#include "FramePacer.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace gps {
+
+    const double FramePacer::SPIN_SECONDS = 0.002;
+
+    const char* getPacingModeName(PACING_MODE mode) {
+        switch (mode) {
+        case PACING_ADAPTIVE:
+            return "adaptive";
+        case PACING_UNCAPPED:
+            return "uncapped";
+        case PACING_FIXED:
+            return "fixed";
+        default:
+            return "vsync";
+        }
+    }
+
+    bool ParsePacingMode(const char* name, PACING_MODE& mode) {
+        const PACING_MODE modes[] = { PACING_VSYNC, PACING_ADAPTIVE, PACING_UNCAPPED, PACING_FIXED };
+        for (int i = 0; i < 4; i++) {
+            if (strcmp(name, getPacingModeName(modes[i])) == 0) {
+                mode = modes[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void FramePacer::Samples::add(double value) {
+        values[next] = value;
+        next = (next + 1) % SAMPLE_COUNT;
+        if (count < SAMPLE_COUNT)
+            count++;
+    }
+
+    double FramePacer::Samples::average() const {
+        double sum = 0.0;
+        for (int i = 0; i < count; i++)
+            sum += values[i];
+        return count > 0 ? sum / count : 0.0;
+    }
+
+    double FramePacer::Samples::maximum() const {
+        double result = 0.0;
+        for (int i = 0; i < count; i++)
+            result = values[i] > result ? values[i] : result;
+        return result;
+    }
+
+    void FramePacer::Init(GLFWwindow* window, PACING_MODE mode, double fixedRate) {
+        this->window = window;
+        this->mode = mode;
+        interval = 1.0 / fixedRate;
+        nextFrame = 0.0;
+
+        if (mode == PACING_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+            std::cout << "Adaptive vsync is not supported, using vsync" << std::endl;
+            this->mode = PACING_VSYNC;
+        }
+        switch (this->mode) {
+        case PACING_VSYNC:
+            glfwSwapInterval(1);
+            break;
+        case PACING_ADAPTIVE:
+            glfwSwapInterval(-1);
+            break;
+        default:
+            glfwSwapInterval(0);
+            break;
+        }
+    }
+
+    void FramePacer::Wait() {
+        if (mode != PACING_FIXED)
+            return;
+
+        double now = glfwGetTime();
+        // more than a frame late, start counting again instead of rushing the next frames
+        if (nextFrame < now - interval)
+            nextFrame = now;
+        double sleep = nextFrame - now - SPIN_SECONDS;
+        if (sleep > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+        while (glfwGetTime() < nextFrame)
+            std::this_thread::yield();
+        nextFrame += interval;
+    }
+
+    void FramePacer::Present(double inputTime, unsigned long long inputSequence) {
+        glfwSwapBuffers(window);
+
+        double now = glfwGetTime();
+        if (lastPresent > 0.0)
+            frameTimes.add(now - lastPresent);
+        lastPresent = now;
+        if (inputSequence != lastInputSequence) {
+            lastInputSequence = inputSequence;
+            latencies.add(now - inputTime);
+        }
+    }
+
+    PACING_MODE FramePacer::getMode() const {
+        return mode;
+    }
+
+    double FramePacer::getFrameMilliseconds() const {
+        return frameTimes.average() * 1000.0;
+    }
+
+    double FramePacer::getLatencyMilliseconds() const {
+        return latencies.average() * 1000.0;
+    }
+
+    double FramePacer::getMaxLatencyMilliseconds() const {
+        return latencies.maximum() * 1000.0;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef FramePacer_hpp
+#define FramePacer_hpp
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+namespace gps {
+
+    // How the frames go to the display:
+    //   vsync    - swap interval 1, every swap waits for the vertical blank
+    //   adaptive - swap interval -1 (EXT_swap_control_tear), a late frame tears instead of waiting a whole refresh
+    //   uncapped - swap interval 0, as fast as the GPU goes
+    //   fixed    - swap interval 0, frames start at a fixed rate, sleeping first and spinning the last bit
+    enum PACING_MODE {
+        PACING_VSYNC,
+        PACING_ADAPTIVE,
+        PACING_UNCAPPED,
+        PACING_FIXED
+    };
+
+    const char* getPacingModeName(PACING_MODE mode);
+    // false if name is not vsync, adaptive, uncapped or fixed
+    bool ParsePacingMode(const char* name, PACING_MODE& mode);
+
+    // Paces the frames of the render thread and measures the time from an input to the present
+    // of the first frame that shows it. Times are in glfwGetTime seconds.
+    class FramePacer
+    {
+    public:
+        // sets the swap interval of the current context, adaptive falls back to vsync without the extension
+        void Init(GLFWwindow* window, PACING_MODE mode, double fixedRate = 60.0);
+
+        // waits until the next frame may start, only the fixed mode ever waits here
+        void Wait();
+        // Swaps the buffers. inputTime is the newest input the frame shows and inputSequence counts
+        // the inputs, every new one adds a latency sample.
+        void Present(double inputTime, unsigned long long inputSequence);
+
+        PACING_MODE getMode() const;
+        // averages over the last SAMPLE_COUNT frames and inputs
+        double getFrameMilliseconds() const;
+        double getLatencyMilliseconds() const;
+        double getMaxLatencyMilliseconds() const;
+
+    private:
+        static const int SAMPLE_COUNT = 120;
+        // the fixed mode sleeps until this long before the frame starts, sleeps can overshoot by a timer tick
+        static const double SPIN_SECONDS;
+
+        struct Samples {
+            double values[SAMPLE_COUNT];
+            int next = 0;
+            int count = 0;
+
+            void add(double value);
+            double average() const;
+            double maximum() const;
+        };
+
+        GLFWwindow* window = NULL;
+        PACING_MODE mode = PACING_VSYNC;
+        double interval = 1.0 / 60.0;
+        double nextFrame = 0.0;
+        double lastPresent = 0.0;
+        unsigned long long lastInputSequence = 0;
+        Samples frameTimes;
+        Samples latencies;
+    };
+}
+
+#endif /* FramePacer_hpp */
@@ -0,0 +1,169 @@
+#include "Frustum.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+#include <cmath>
+
+namespace gps {
+
+    void BoxList::clear() {
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    void BoxList::push(const BoundingBox& box, const glm::mat4& transform) {
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+        glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+        glm::vec3 worldExtent;
+        for (int row = 0; row < 3; row++) {
+            worldExtent[row] = std::fabs(transform[0][row]) * extent.x
+                + std::fabs(transform[1][row]) * extent.y
+                + std::fabs(transform[2][row]) * extent.z;
+        }
+
+        centerX.push_back(worldCenter.x);
+        centerY.push_back(worldCenter.y);
+        centerZ.push_back(worldCenter.z);
+        extentX.push_back(worldExtent.x);
+        extentY.push_back(worldExtent.y);
+        extentZ.push_back(worldExtent.z);
+    }
+
+    size_t BoxList::size() const {
+        return centerX.size();
+    }
+
+    void Frustum::extract(const glm::mat4& m) {
+        // rows of the matrix (glm is column major)
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        planes[0] = row3 + row0; // left
+        planes[1] = row3 - row0; // right
+        planes[2] = row3 + row1; // bottom
+        planes[3] = row3 - row1; // top
+        planes[4] = row3 + row2; // near
+        planes[5] = row3 - row2; // far
+
+        for (int i = 0; i < 6; i++) {
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+        }
+    }
+
+    bool Frustum::isVisible(float cx, float cy, float cz, float ex, float ey, float ez) const {
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& p = planes[i];
+            float distance = p.x * cx + p.y * cy + p.z * cz + p.w;
+            float radius = std::fabs(p.x) * ex + std::fabs(p.y) * ey + std::fabs(p.z) * ez;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool Frustum::isVisible(const BoundingBox& box) const {
+        glm::vec3 c = (box.min + box.max) * 0.5f;
+        glm::vec3 e = (box.max - box.min) * 0.5f;
+        return isVisible(c.x, c.y, c.z, e.x, e.y, e.z);
+    }
+
+    FRUSTUM_TEST Frustum::classify(const BoundingBox& box) const {
+        glm::vec3 c = (box.min + box.max) * 0.5f;
+        glm::vec3 e = (box.max - box.min) * 0.5f;
+        FRUSTUM_TEST result = FRUSTUM_INSIDE;
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& p = planes[i];
+            float distance = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            float radius = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+            if (distance + radius < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            if (distance - radius < 0.0f)
+                result = FRUSTUM_INTERSECTS;
+        }
+        return result;
+    }
+
+    bool Frustum::isVisible(const BoundingSphere& sphere) const {
+        for (int i = 0; i < 6; i++) {
+            if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+
+    void Frustum::cullBoxes(const BoxList& boxes, std::vector<unsigned char>& visible) const {
+        size_t count = boxes.size();
+        visible.resize(count);
+        size_t i = 0;
+
+#if defined(FRUSTUM_AVX)
+        // 8 boxes per iteration
+        for (; i + 8 <= count; i += 8) {
+            __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+            __m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+            __m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+            __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+            __m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+            __m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = planes[p];
+                __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(plane.x)), _mm256_mul_ps(cy, _mm256_set1_ps(plane.y))),
+                    _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+                __m256 radius = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(std::fabs(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(std::fabs(plane.y)))),
+                    _mm256_mul_ps(ez, _mm256_set1_ps(std::fabs(plane.z))));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; k++)
+                visible[i + k] = (mask >> k) & 1;
+        }
+#elif defined(FRUSTUM_SSE)
+        // 4 boxes per iteration
+        for (; i + 4 <= count; i += 4) {
+            __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+            __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+            __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+            __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+            __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = planes[p];
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+                    _mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++)
+                visible[i + k] = (mask >> k) & 1;
+        }
+#endif
+
+        // remaining boxes (or everything without SIMD)
+        for (; i < count; i++) {
+            visible[i] = isVisible(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i],
+                boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]) ? 1 : 0;
+        }
+    }
+}
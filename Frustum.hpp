@@ -0,0 +1,57 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Visible/culled mesh counters, reset every frame
+    struct CullStats {
+        unsigned int visible = 0;
+        // outside the view frustum
+        unsigned int culled = 0;
+        // inside the frustum, but hidden behind occluders
+        unsigned int occluded = 0;
+
+        void reset() { visible = 0; culled = 0; occluded = 0; }
+    };
+
+    // World space boxes stored as center/extent arrays, so they can be tested 4 or 8 at a time
+    struct BoxList {
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+
+        void clear();
+        // adds the box transformed to world space (the result is the box around the transformed box)
+        void push(const BoundingBox& box, const glm::mat4& transform);
+        size_t size() const;
+    };
+
+    enum FRUSTUM_TEST {FRUSTUM_OUTSIDE, FRUSTUM_INTERSECTS, FRUSTUM_INSIDE};
+
+    class Frustum
+    {
+    public:
+        // extracts the six planes from projection * view, normals point inside
+        void extract(const glm::mat4& viewProjection);
+
+        bool isVisible(const BoundingBox& box) const;
+        bool isVisible(const BoundingSphere& sphere) const;
+        // like isVisible, but also tells if the box is completely inside
+        FRUSTUM_TEST classify(const BoundingBox& box) const;
+
+        // visible[i] is set to 1 if box i intersects the frustum, 0 otherwise
+        void cullBoxes(const BoxList& boxes, std::vector<unsigned char>& visible) const;
+
+    private:
+        glm::vec4 planes[6];
+
+        bool isVisible(float cx, float cy, float cz, float ex, float ey, float ez) const;
+    };
+}
+
+#endif /* Frustum_hpp */
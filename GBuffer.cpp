@@ -0,0 +1,97 @@
+#include "GBuffer.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+        GLuint CreateTarget(GLenum internalFormat, GLenum format, GLenum type, int width, int height) {
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+            // read one texel per pixel
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            return texture;
+        }
+    }
+
+    void GBuffer::Init() {
+        glGenFramebuffers(1, &framebuffer);
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    void GBuffer::Delete() {
+        DeleteAttachments();
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteVertexArrays(1, &emptyVAO);
+        framebuffer = 0;
+        emptyVAO = 0;
+    }
+
+    void GBuffer::DeleteAttachments() {
+        GLuint textures[] = { albedoTexture, normalTexture, depthTexture };
+        glDeleteTextures(3, textures);
+        albedoTexture = normalTexture = depthTexture = 0;
+        width = height = 0;
+    }
+
+    void GBuffer::Resize(int width, int height) {
+        if (width == this->width && height == this->height)
+            return;
+        DeleteAttachments();
+        this->width = width;
+        this->height = height;
+
+        albedoTexture = CreateTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        normalTexture = CreateTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+        depthTexture = CreateTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR: G-buffer " << width << "x" << height << " is incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void GBuffer::BindFramebuffer() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    void GBuffer::BindTextures(GLuint program) const {
+        const char* names[] = { "gAlbedoSpecular", "gNormal", "gDepth" };
+        GLuint textures[] = { albedoTexture, normalTexture, depthTexture };
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glUniform1i(glGetUniformLocation(program, names[i]), FIRST_TEXTURE_UNIT + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void GBuffer::DrawFullscreenTriangle() const {
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+    int GBuffer::getWidth() const {
+        return width;
+    }
+
+    int GBuffer::getHeight() const {
+        return height;
+    }
+
+    int GBuffer::getBytesPerPixel() {
+        return 4 + 4 + 4;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef GBuffer_hpp
+#define GBuffer_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Render targets of the deferred path, 12 bytes per pixel:
+    //   albedo RGBA8 - diffuse color, specular intensity in alpha
+    //   normal RG16  - octahedral encoded eye space normal
+    //   depth 32F    - the eye space position is rebuilt from it with the inverse projection
+    // The lighting pass (deferred.frag) reads them with a full screen triangle.
+    class GBuffer
+    {
+    public:
+        void Init();
+        void Delete();
+        // (re)creates the attachments if the size changed
+        void Resize(int width, int height);
+
+        // the G-buffer pass draws into the attachments
+        void BindFramebuffer() const;
+        // binds the attachments to texture units (FIRST_TEXTURE_UNIT and up) and sets the samplers of the bound program
+        void BindTextures(GLuint program) const;
+        // covers the screen, the vertices come from gl_VertexID
+        void DrawFullscreenTriangle() const;
+
+        int getWidth() const;
+        int getHeight() const;
+        static int getBytesPerPixel();
+
+    private:
+        static const int FIRST_TEXTURE_UNIT = 4;
+
+        GLuint framebuffer = 0;
+        GLuint albedoTexture = 0;
+        GLuint normalTexture = 0;
+        GLuint depthTexture = 0;
+        // core profile draws need a vertex array, even an empty one
+        GLuint emptyVAO = 0;
+        int width = 0;
+        int height = 0;
+
+        void DeleteAttachments();
+    };
+}
+
+#endif /* GBuffer_hpp */
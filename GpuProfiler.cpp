@@ -0,0 +1,193 @@
+#include "GpuProfiler.hpp"
+
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    void GpuProfiler::Init() {
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            frames[i].usedQueries = 0;
+            frames[i].records.clear();
+            frames[i].pending = false;
+        }
+        current = 0;
+        droppedFrames = 0;
+    }
+
+    void GpuProfiler::Delete() {
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            if (!frames[i].queries.empty())
+                glDeleteQueries((GLsizei)frames[i].queries.size(), &frames[i].queries[0]);
+            frames[i].queries.clear();
+            frames[i].pending = false;
+        }
+    }
+
+    int GpuProfiler::NextQuery(Frame& frame) {
+        if (frame.usedQueries == (int)frame.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        glQueryCounter(frame.queries[frame.usedQueries], GL_TIMESTAMP);
+        return frame.usedQueries++;
+    }
+
+    int GpuProfiler::FindScope(const std::string& path, int depth) {
+        std::map<std::string, int>::const_iterator found = scopeIndices.find(path);
+        if (found != scopeIndices.end())
+            return found->second;
+
+        Scope scope;
+        scope.path = path;
+        scope.depth = depth;
+        scope.frames = 0;
+        scope.last = scope.total = scope.historySum = 0.0;
+        scope.minimum = scope.maximum = 0.0;
+        for (int i = 0; i < AVERAGE_FRAMES; i++)
+            scope.history[i] = 0.0;
+        scopes.push_back(scope);
+        scopeIndices[path] = (int)scopes.size() - 1;
+        return (int)scopes.size() - 1;
+    }
+
+    bool GpuProfiler::ReadFrame(Frame& frame) {
+        // the GPU finishes the queries in order, the frame scope ends last
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.records[0].endQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+
+        std::vector<double> milliseconds(scopes.size(), 0.0);
+        for (size_t i = 0; i < frame.records.size(); i++) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[frame.records[i].beginQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[frame.records[i].endQuery], GL_QUERY_RESULT, &end);
+            milliseconds[frame.records[i].scope] += (end - begin) / 1000000.0;
+        }
+
+        for (size_t i = 0; i < scopes.size(); i++) {
+            Scope& scope = scopes[i];
+            double value = milliseconds[i];
+            int slot = scope.frames % AVERAGE_FRAMES;
+            scope.historySum += value - scope.history[slot];
+            scope.history[slot] = value;
+            scope.minimum = scope.frames == 0 || value < scope.minimum ? value : scope.minimum;
+            scope.maximum = scope.frames == 0 || value > scope.maximum ? value : scope.maximum;
+            scope.last = value;
+            scope.total += value;
+            scope.frames++;
+        }
+        frame.pending = false;
+        return true;
+    }
+
+    void GpuProfiler::BeginFrame() {
+        // oldest frame first, the one about to be reused is the oldest
+        for (int i = 0; i < FRAME_COUNT; i++) {
+            Frame& frame = frames[(current + i) % FRAME_COUNT];
+            if (frame.pending && !ReadFrame(frame))
+                break;
+        }
+        // still running after FRAME_COUNT frames: dropped rather than waited for
+        Frame& frame = frames[current];
+        if (frame.pending)
+            droppedFrames++;
+
+        frame.pending = false;
+        frame.usedQueries = 0;
+        frame.records.clear();
+        stack.clear();
+        Begin("frame");
+    }
+
+    void GpuProfiler::EndFrame() {
+        // closes whatever was left open, the frame scope last
+        if (stack.size() > 1)
+            std::cout << "ERROR: GPU profiler scope " << scopes[frames[current].records[stack.back()].scope].path << " was not ended" << std::endl;
+        while (!stack.empty())
+            End();
+        frames[current].pending = true;
+        current = (current + 1) % FRAME_COUNT;
+    }
+
+    void GpuProfiler::Begin(const char* name) {
+        Frame& frame = frames[current];
+        std::string path = stack.empty() ? std::string(name) : scopes[frame.records[stack.back()].scope].path + "/" + name;
+
+        Record record;
+        record.scope = FindScope(path, (int)stack.size());
+        record.beginQuery = NextQuery(frame);
+        record.endQuery = -1;
+        frame.records.push_back(record);
+        stack.push_back((int)frame.records.size() - 1);
+    }
+
+    void GpuProfiler::End() {
+        if (stack.empty())
+            return;
+        Frame& frame = frames[current];
+        frame.records[stack.back()].endQuery = NextQuery(frame);
+        stack.pop_back();
+    }
+
+    const GpuProfiler::Scope* GpuProfiler::getScope(const std::string& path) const {
+        std::map<std::string, int>::const_iterator found = scopeIndices.find(path);
+        return found != scopeIndices.end() ? &scopes[found->second] : NULL;
+    }
+
+    double GpuProfiler::getMilliseconds(const std::string& path) const {
+        const Scope* scope = getScope(path);
+        if (scope == NULL || scope->frames == 0)
+            return 0.0;
+        int count = scope->frames < AVERAGE_FRAMES ? scope->frames : AVERAGE_FRAMES;
+        return scope->historySum / count;
+    }
+
+    double GpuProfiler::getLastMilliseconds(const std::string& path) const {
+        const Scope* scope = getScope(path);
+        return scope != NULL ? scope->last : 0.0;
+    }
+
+    int GpuProfiler::getDroppedFrames() const {
+        return droppedFrames;
+    }
+
+    void GpuProfiler::Print(std::ostream& out) const {
+        for (size_t i = 0; i < scopes.size(); i++) {
+            const Scope& scope = scopes[i];
+            std::string name = scope.path.substr(scope.path.rfind('/') + 1);
+            out << "GPU " << std::string(scope.depth * 2, ' ') << name << ": " << getMilliseconds(scope.path) << " ms" << std::endl;
+        }
+    }
+
+    bool GpuProfiler::WriteCsv(const std::string& fileName) const {
+        std::ofstream file(fileName.c_str());
+        if (!file)
+            return false;
+        file << "scope,depth,frames,last_ms,rolling_ms,mean_ms,min_ms,max_ms\n";
+        for (size_t i = 0; i < scopes.size(); i++) {
+            const Scope& scope = scopes[i];
+            file << scope.path << "," << scope.depth << "," << scope.frames << "," << scope.last << "," << getMilliseconds(scope.path)
+                << "," << (scope.frames > 0 ? scope.total / scope.frames : 0.0) << "," << scope.minimum << "," << scope.maximum << "\n";
+        }
+        return (bool)file;
+    }
+
+    bool GpuProfiler::WriteJson(const std::string& fileName) const {
+        std::ofstream file(fileName.c_str());
+        if (!file)
+            return false;
+        file << "{\n  \"droppedFrames\": " << droppedFrames << ",\n  \"scopes\": [";
+        for (size_t i = 0; i < scopes.size(); i++) {
+            const Scope& scope = scopes[i];
+            file << (i > 0 ? ",\n" : "\n") << "    { \"scope\": \"" << scope.path << "\", \"depth\": " << scope.depth
+                << ", \"frames\": " << scope.frames << ", \"lastMs\": " << scope.last << ", \"rollingMs\": " << getMilliseconds(scope.path)
+                << ", \"meanMs\": " << (scope.frames > 0 ? scope.total / scope.frames : 0.0)
+                << ", \"minMs\": " << scope.minimum << ", \"maxMs\": " << scope.maximum << " }";
+        }
+        file << "\n  ]\n}\n";
+        return (bool)file;
+    }
+}
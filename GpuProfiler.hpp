@@ -0,0 +1,91 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#include <GL/glew.h>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // GPU time of nested named scopes, measured with GL_TIMESTAMP queries at both ends of every scope
+    // (GL_TIME_ELAPSED queries can not nest). Each of the last FRAME_COUNT frames has its own queries,
+    // a frame's results are read once the GPU is done with it, so the CPU never waits on the GPU.
+    // Scopes are named by their path from the frame scope, e.g. "frame/main pass/static batch".
+    class GpuProfiler
+    {
+    public:
+        void Init();
+        void Delete();
+
+        // reads the results of the finished frames and opens the "frame" scope
+        void BeginFrame();
+        void EndFrame();
+        // scopes nest inside the frame, a scope used more than once per frame adds up
+        void Begin(const char* name);
+        void End();
+
+        // rolling average over the last AVERAGE_FRAMES frames, and the newest result, 0 if unknown.
+        // Frames in which a scope did not run count as 0.
+        double getMilliseconds(const std::string& path) const;
+        double getLastMilliseconds(const std::string& path) const;
+        // frames whose results were not ready when their queries had to be reused
+        int getDroppedFrames() const;
+
+        // one line per scope with the rolling average, indented by depth
+        void Print(std::ostream& out) const;
+        // every scope with its frame count and last, rolling, mean, min and max milliseconds.
+        // false if the file can not be written
+        bool WriteCsv(const std::string& fileName) const;
+        bool WriteJson(const std::string& fileName) const;
+
+    private:
+        // frames in flight before their queries are reused
+        static const int FRAME_COUNT = 4;
+        static const int AVERAGE_FRAMES = 64;
+
+        struct Scope {
+            std::string path;
+            int depth;
+            int frames;
+            double last;
+            double total;
+            double minimum;
+            double maximum;
+            double history[AVERAGE_FRAMES];
+            double historySum;
+        };
+
+        // one use of a scope, with the indices of its queries in the frame
+        struct Record {
+            int scope;
+            int beginQuery;
+            int endQuery;
+        };
+
+        struct Frame {
+            std::vector<GLuint> queries;
+            int usedQueries = 0;
+            std::vector<Record> records;
+            bool pending = false;
+        };
+
+        Frame frames[FRAME_COUNT];
+        int current = 0;
+        std::vector<Scope> scopes;
+        std::map<std::string, int> scopeIndices;
+        // open records of the current frame
+        std::vector<int> stack;
+        int droppedFrames = 0;
+
+        int NextQuery(Frame& frame);
+        int FindScope(const std::string& path, int depth);
+        // false if the results are not there yet
+        bool ReadFrame(Frame& frame);
+        const Scope* getScope(const std::string& path) const;
+    };
+}
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,99 @@
+#include "JobSystem.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    JobSystem::~JobSystem() {
+        Shutdown();
+    }
+
+    void JobSystem::Init(unsigned int threadCount) {
+        Shutdown();
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        stopping = false;
+        nextRange = 0;
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.push_back(std::thread(&JobSystem::WorkerLoop, this, generation));
+    }
+
+    void JobSystem::Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    unsigned int JobSystem::getThreadCount() const {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    void JobSystem::ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function) {
+        if (count == 0)
+            return;
+        grainSize = std::max((size_t)1, grainSize);
+
+        // not worth waking anybody for a single range
+        if (workers.empty() || count <= grainSize) {
+            for (size_t begin = 0; begin < count; begin += grainSize)
+                function(begin, std::min(count, begin + grainSize));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            jobCount = count;
+            jobGrain = grainSize;
+            nextRange = 0;
+            busyWorkers = (unsigned int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        RunRanges();
+
+        // the job lives on the caller's stack, wait until no worker can touch it anymore
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        job = NULL;
+    }
+
+    void JobSystem::WorkerLoop(unsigned int seenGeneration) {
+        gps::CpuProfiler::setThreadName("job worker");
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seenGeneration] { return stopping || generation != seenGeneration; });
+                if (stopping)
+                    return;
+                seenGeneration = generation;
+            }
+
+            RunRanges();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+
+    void JobSystem::RunRanges() {
+        for (;;) {
+            size_t begin = nextRange.fetch_add(jobGrain);
+            if (begin >= jobCount)
+                return;
+            (*job)(begin, std::min(jobCount, begin + jobGrain));
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef JobSystem_hpp
+#define JobSystem_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Pool of worker threads that live for the whole program. The calling thread also takes
+    // part in every job, so a pool of one thread runs everything inline.
+    class JobSystem
+    {
+    public:
+        ~JobSystem();
+
+        // threadCount counts the calling thread too, 0 uses every hardware thread
+        void Init(unsigned int threadCount = 0);
+        void Shutdown();
+
+        unsigned int getThreadCount() const;
+
+        // Calls function(begin, end) for the ranges [0, grainSize), [grainSize, 2 * grainSize), ...
+        // up to count, spread over all threads, and returns once every range is done.
+        // Ranges always start at a multiple of grainSize, so begin / grainSize identifies them.
+        void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function);
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        bool stopping = false;
+
+        // current job, only changed while no worker is running it
+        const std::function<void(size_t, size_t)>* job = NULL;
+        size_t jobCount = 0;
+        size_t jobGrain = 1;
+        unsigned int generation = 0;
+        unsigned int busyWorkers = 0;
+        std::atomic<size_t> nextRange;
+
+        // seenGeneration is the job generation when the worker was started
+        void WorkerLoop(unsigned int seenGeneration);
+        void RunRanges();
+    };
+}
+
+#endif /* JobSystem_hpp */
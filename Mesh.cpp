@@ -1,12 +1,48 @@
 #include "Mesh.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+
 namespace gps {
 
+	unsigned int getMaterialFeatures(const std::vector<Texture>& textures)
+	{
+		unsigned int features = 0;
+		for (size_t i = 0; i < textures.size(); i++) {
+			if (textures[i].type == "specularTexture")
+				features |= SHADER_SPECULAR_MAP;
+			else if (textures[i].type == "alphaTexture")
+				features |= SHADER_ALPHA_TEST;
+		}
+		return features;
+	}
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->shaderFeatures = getMaterialFeatures(textures);
+
+		MeshLod lod;
+		lod.indexOffset = 0;
+		lod.indexCount = (GLuint)indices.size();
+		lod.error = 0.0f;
+		this->lods.push_back(lod);
+
+		this->setupMesh();
+	}
+
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, std::vector<MeshLod> lods,
+		VERTEX_FORMAT vertexFormat)
+	{
+		this->vertices = vertices;
+		this->indices = indices;
+		this->textures = textures;
+		this->shaderFeatures = getMaterialFeatures(textures);
+		this->lods = lods;
+		this->vertexFormat = vertexFormat;
 
 		this->setupMesh();
 	}
@@ -18,6 +54,12 @@ namespace gps {
 	/* Mesh drawing function - also applies associated textures */
 	void Mesh::Draw(gps::Shader shader)
 	{
+		Draw(shader, 0);
+	}
+
+	void Mesh::Draw(gps::Shader shader, int lod)
+	{
+		CPU_SCOPE("Mesh::Draw");
 		shader.useShaderProgram();
 
 		//set textures
@@ -28,8 +70,14 @@ namespace gps {
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
+		// decoding of the packed vertex formats
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionScale"), 1, &this->decode.positionScale[0]);
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionBias"), 1, &this->decode.positionBias[0]);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "octahedralNormals"), this->vertexFormat == VERTEX_FORMAT_OCT16);
+
 		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		const MeshLod& range = this->lods[lod];
+		glDrawElements(GL_TRIANGLES, range.indexCount, this->indexType, (GLvoid*)(size_t)(range.indexOffset * getIndexSize()));
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++)
@@ -40,6 +88,63 @@ namespace gps {
 
     }
 
+	void Mesh::DrawDepth(gps::Shader shader, int lod)
+	{
+		shader.useShaderProgram();
+
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionScale"), 1, &this->decode.positionScale[0]);
+		glUniform3fv(glGetUniformLocation(shader.shaderProgram, "positionBias"), 1, &this->decode.positionBias[0]);
+
+		glBindVertexArray(this->buffers.depthVAO);
+		const MeshLod& range = this->lods[lod];
+		glDrawElements(GL_TRIANGLES, range.indexCount, this->indexType, (GLvoid*)(size_t)(range.indexOffset * getIndexSize()));
+		glBindVertexArray(0);
+	}
+
+	int Mesh::SelectLod(const LodSettings& settings, const glm::mat4& modelMatrix)
+	{
+		// coarser levels only once their error is this far under the threshold
+		const float HYSTERESIS = 0.75f;
+
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(this->sphere.center, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		float distance = glm::length(center - settings.cameraPosition) - this->sphere.radius * scale;
+		if (distance <= 0.0f) {
+			this->currentLod = 0;
+			return 0;
+		}
+
+		float pixelsPerUnit = scale * settings.projectionScale / distance;
+		int target = 0;
+		for (int i = 1; i < (int)this->lods.size(); i++) {
+			if (this->lods[i].error * pixelsPerUnit <= settings.threshold)
+				target = i;
+		}
+		while (target > this->currentLod && this->lods[target].error * pixelsPerUnit > settings.threshold * HYSTERESIS)
+			target--;
+
+		this->currentLod = target;
+		return target;
+	}
+
+	GLsizei Mesh::getIndexSize() const
+	{
+		return this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	unsigned int Mesh::getShaderFeatures() const
+	{
+		return this->shaderFeatures;
+	}
+
+	std::vector<GLuint> Mesh::getLodIndices(int lod) const
+	{
+		const MeshLod& range = this->lods[lod];
+		return std::vector<GLuint>(this->indices.begin() + range.indexOffset,
+			this->indices.begin() + range.indexOffset + range.indexCount);
+	}
+
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
 		// Create buffers/arrays
@@ -49,22 +154,36 @@ namespace gps {
 
 		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
+		std::vector<unsigned char> vertexData;
+		this->decode = PackVertices(this->vertices, this->vertexFormat, vertexData);
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexData.size(), &vertexData[0], GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		if (this->vertices.size() <= MAX_16BIT_VERTICES) {
+			this->indexType = GL_UNSIGNED_SHORT;
+			std::vector<GLushort> shortIndices(this->indices.begin(), this->indices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+		}
+		else {
+			this->indexType = GL_UNSIGNED_INT;
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		}
 
 		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		SetupVertexAttributes(this->vertexFormat);
+
+		// Positions split out of the interleaved buffer, depth passes fetch nothing else
+		glGenVertexArrays(1, &this->buffers.depthVAO);
+		glGenBuffers(1, &this->buffers.positionVBO);
+
+		glBindVertexArray(this->buffers.depthVAO);
+		std::vector<unsigned char> positionData;
+		PackPositions(this->vertices, this->vertexFormat, positionData);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.positionVBO);
+		glBufferData(GL_ARRAY_BUFFER, positionData.size(), &positionData[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+		SetupPositionAttribute(this->vertexFormat);
 
 		glBindVertexArray(0);
 	}
@@ -5,6 +5,7 @@
 #include "glm/glm.hpp"
 
 #include "Shader.hpp"
+#include "VertexFormat.hpp"
 
 #include <string>
 #include <vector>
@@ -22,11 +23,14 @@ struct Vertex
 struct Texture
 {
     GLuint id;
-    //ambientTexture, diffuseTexture, specularTexture
+    //ambientTexture, diffuseTexture, specularTexture, alphaTexture
     std::string type;
     std::string path;
 };
 
+// SHADER_* features needed by a material with these textures
+unsigned int getMaterialFeatures(const std::vector<Texture>& textures);
+
 struct Material
     {
         glm::vec3 ambient;
@@ -34,10 +38,46 @@ struct Material
         glm::vec3 specular;
     };
 
+// Axis aligned bounding box, in the space of the vertices it was computed from
+struct BoundingBox {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Meshes with at most this many vertices are drawn with 16-bit indices
+const GLuint MAX_16BIT_VERTICES = 65536;
+
+// Range of the index buffer holding one level of detail
+struct MeshLod {
+    GLuint indexOffset;
+    GLuint indexCount;
+    // estimated distance of the simplified surface from the original one, in object space:
+    // the RMS quadric error of the worst collapse, summed over the simplification passes.
+    // A typical deviation, not a bound, parts of the surface can be further off.
+    float error;
+};
+
+// Viewer parameters for picking a level of detail from its projected error
+struct LodSettings {
+    glm::vec3 cameraPosition;
+    // viewport height / (2 * tan(fovy / 2)), pixels covered by one unit seen at distance one
+    float projectionScale;
+    // acceptable estimated error, in pixels, a budget for the RMS error and not a hard limit
+    float threshold;
+};
+
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    // position-only stream for depth passes, sharing the EBO
+    GLuint depthVAO;
+    GLuint positionVBO;
 };
 
 class Mesh
@@ -46,16 +86,51 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    // object space bounding volumes, filled in by Model3D::ReadOBJ
+    BoundingBox bounds;
+    BoundingSphere sphere;
+    // levels of detail stored one after the other in indices, finest first
+    std::vector<MeshLod> lods;
+    // layout of the GPU copy of the vertices, vertices always stays in full floats
+    VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FULL;
+    VertexDecode decode;
+    // GL_UNSIGNED_SHORT when the vertices fit, GL_UNSIGNED_INT otherwise; indices stays in GLuint
+    GLenum indexType = GL_UNSIGNED_INT;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, std::vector<MeshLod> lods,
+		VERTEX_FORMAT vertexFormat = VERTEX_FORMAT_FULL);
+
 	Buffers getBuffers();
 
 	void Draw(gps::Shader shader);
 
+	void Draw(gps::Shader shader, int lod);
+
+	// Positions only, for depth passes (no textures bound)
+	void DrawDepth(gps::Shader shader, int lod);
+
+	// Coarsest level whose projected error estimate stays under the threshold. Going to a coarser
+	// level needs some margin below it, so meshes near the limit do not pop back and forth.
+	int SelectLod(const LodSettings& settings, const glm::mat4& modelMatrix);
+
+	// Bytes per index in the EBO
+	GLsizei getIndexSize() const;
+
+	// SHADER_* features of the material
+	unsigned int getShaderFeatures() const;
+
+	// Copy of the indices of one level
+	std::vector<GLuint> getLodIndices(int lod) const;
+
 private:
     /*  Render data  */
     Buffers buffers;
+    // level picked by the last SelectLod call
+    int currentLod = 0;
+    // SHADER_* features of the textures
+    unsigned int shaderFeatures = 0;
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
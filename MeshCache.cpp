@@ -0,0 +1,175 @@
+#include "MeshCache.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    namespace {
+        const unsigned int MAGIC = 0x4d535047; // "GPSM"
+
+        template <typename T>
+        void WriteValue(std::ofstream& file, const T& value) {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void WriteArray(std::ofstream& file, const std::vector<T>& values) {
+            unsigned int count = (unsigned int)values.size();
+            WriteValue(file, count);
+            if (count > 0)
+                file.write(reinterpret_cast<const char*>(&values[0]), sizeof(T) * count);
+        }
+
+        void WriteString(std::ofstream& file, const std::string& value) {
+            unsigned int length = (unsigned int)value.size();
+            WriteValue(file, length);
+            file.write(value.data(), length);
+        }
+
+        template <typename T>
+        bool ReadValue(std::ifstream& file, T& value) {
+            file.read(reinterpret_cast<char*>(&value), sizeof(T));
+            return (bool)file;
+        }
+
+        template <typename T>
+        bool ReadArray(std::ifstream& file, std::vector<T>& values) {
+            unsigned int count;
+            if (!ReadValue(file, count))
+                return false;
+            values.resize(count);
+            if (count > 0)
+                file.read(reinterpret_cast<char*>(&values[0]), sizeof(T) * count);
+            return (bool)file;
+        }
+
+        bool ReadString(std::ifstream& file, std::string& value) {
+            unsigned int length;
+            if (!ReadValue(file, length))
+                return false;
+            value.resize(length);
+            if (length > 0)
+                file.read(&value[0], length);
+            return (bool)file;
+        }
+    }
+
+    std::string MeshCache::getCachePath(const std::string& sourcePath) {
+        return sourcePath + ".cache";
+    }
+
+    void MeshCache::HashBytes(const char* data, size_t size, unsigned long long& hash) {
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+
+    bool MeshCache::HashFile(const std::string& path, unsigned long long& hash) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+
+        char buffer[64 * 1024];
+        while (file) {
+            file.read(buffer, sizeof(buffer));
+            HashBytes(buffer, (size_t)file.gcount(), hash);
+        }
+        return true;
+    }
+
+    bool MeshCache::HashSource(const std::string& objPath, const std::string& basePath, unsigned long long& hash) {
+        std::ifstream file(objPath.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+
+        hash = 14695981039346656037ull;
+        HashBytes(basePath.data(), basePath.size(), hash);
+
+        // the .obj line by line, picking up the material libraries on the way
+        std::vector<std::string> materialFiles;
+        std::string line;
+        while (std::getline(file, line)) {
+            line += '\n';
+            HashBytes(line.data(), line.size(), hash);
+
+            // tinyobj reads one name per mtllib line, relative to the base path
+            std::istringstream tokens(line);
+            std::string keyword, name;
+            if (tokens >> keyword >> name && keyword == "mtllib")
+                materialFiles.push_back(name);
+        }
+
+        for (size_t i = 0; i < materialFiles.size(); i++) {
+            // a missing library still counts, the cache is rebuilt once it shows up
+            char present = HashFile(basePath + materialFiles[i], hash) ? 1 : 0;
+            HashBytes(&present, 1, hash);
+        }
+        return true;
+    }
+
+    bool MeshCache::Load(const std::string& cachePath, unsigned long long sourceHash, std::vector<gps::MeshData>& meshes) {
+        std::ifstream file(cachePath.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+
+        unsigned int magic, version;
+        unsigned long long hash;
+        unsigned int meshCount;
+        if (!ReadValue(file, magic) || !ReadValue(file, version) || !ReadValue(file, hash) || !ReadValue(file, meshCount))
+            return false;
+        if (magic != MAGIC || version != VERSION || hash != sourceHash)
+            return false;
+
+        std::vector<gps::MeshData> loaded(meshCount);
+        for (unsigned int m = 0; m < meshCount; m++) {
+            gps::MeshData& mesh = loaded[m];
+            if (!ReadArray(file, mesh.vertices) || !ReadArray(file, mesh.indices) || !ReadArray(file, mesh.lods))
+                return false;
+            if (!ReadValue(file, mesh.bounds) || !ReadValue(file, mesh.sphere))
+                return false;
+
+            unsigned int textureCount;
+            if (!ReadValue(file, textureCount))
+                return false;
+            mesh.textures.resize(textureCount);
+            for (unsigned int t = 0; t < textureCount; t++) {
+                mesh.textures[t].id = 0;
+                if (!ReadString(file, mesh.textures[t].type) || !ReadString(file, mesh.textures[t].path))
+                    return false;
+            }
+        }
+
+        meshes.swap(loaded);
+        return true;
+    }
+
+    bool MeshCache::Save(const std::string& cachePath, unsigned long long sourceHash, const std::vector<gps::MeshData>& meshes) {
+        std::ofstream file(cachePath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Could not write the mesh cache " << cachePath << std::endl;
+            return false;
+        }
+
+        unsigned int version = VERSION;
+        WriteValue(file, MAGIC);
+        WriteValue(file, version);
+        WriteValue(file, sourceHash);
+        WriteValue(file, (unsigned int)meshes.size());
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const gps::MeshData& mesh = meshes[m];
+            WriteArray(file, mesh.vertices);
+            WriteArray(file, mesh.indices);
+            WriteArray(file, mesh.lods);
+            WriteValue(file, mesh.bounds);
+            WriteValue(file, mesh.sphere);
+
+            WriteValue(file, (unsigned int)mesh.textures.size());
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                WriteString(file, mesh.textures[t].type);
+                WriteString(file, mesh.textures[t].path);
+            }
+        }
+        return (bool)file;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Cooked mesh, ready to be uploaded. Texture ids are not valid here, only type and path.
+    struct MeshData {
+        std::vector<gps::Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<gps::MeshLod> lods;
+        std::vector<gps::Texture> textures;
+        gps::BoundingBox bounds;
+        gps::BoundingSphere sphere;
+    };
+
+    // Binary cache of the cooked meshes of a model, stored next to the .obj file so the
+    // parsing and the simplifier only run when the .obj, its materials or the base path change
+    class MeshCache
+    {
+    public:
+        // bumped whenever the cooked data changes
+        static const unsigned int VERSION = 4;
+
+        static std::string getCachePath(const std::string& sourcePath);
+
+        // FNV-1a hash of everything the cooked meshes come from: the .obj file, the .mtl files
+        // it references (with their texture names, alpha maps and material splits) and the base
+        // path the textures are found in. The vertex format is applied on upload, it is not cooked.
+        // False if the .obj file can not be read.
+        static bool HashSource(const std::string& objPath, const std::string& basePath, unsigned long long& hash);
+
+        // false if the cache is missing, from an older version or from another source file
+        static bool Load(const std::string& cachePath, unsigned long long sourceHash, std::vector<gps::MeshData>& meshes);
+
+        static bool Save(const std::string& cachePath, unsigned long long sourceHash, const std::vector<gps::MeshData>& meshes);
+
+    private:
+        // continue the FNV-1a hash with more bytes
+        static void HashBytes(const char* data, size_t size, unsigned long long& hash);
+        static bool HashFile(const std::string& path, unsigned long long& hash);
+    };
+}
+
+#endif /* MeshCache_hpp */
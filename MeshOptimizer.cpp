@@ -0,0 +1,282 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    namespace {
+        // FIFO cache simulation, returns the number of misses of every triangle
+        std::vector<unsigned char> SimulateCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize) {
+            std::vector<unsigned int> cachedAt(vertexCount, 0);
+            std::vector<unsigned char> misses(indices.size() / 3);
+            // cachedAt holds the value of time when the vertex entered the cache, 0 if never
+            unsigned int time = cacheSize + 1;
+            for (size_t t = 0; t < misses.size(); t++) {
+                misses[t] = 0;
+                for (int c = 0; c < 3; c++) {
+                    GLuint v = indices[3 * t + c];
+                    if (cachedAt[v] == 0 || time - cachedAt[v] > cacheSize) {
+                        cachedAt[v] = time++;
+                        misses[t]++;
+                    }
+                }
+            }
+            return misses;
+        }
+
+        struct Cluster {
+            size_t firstTriangle;
+            size_t triangleCount;
+            float sortKey;
+        };
+    }
+
+    float VertexCacheStats::getAcmr() const {
+        return triangles > 0 ? (float)misses / triangles : 0.0f;
+    }
+
+    float VertexCacheStats::getAtvr() const {
+        return vertices > 0 ? (float)misses / vertices : 0.0f;
+    }
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize) {
+        VertexCacheStats stats;
+        stats.triangles = indices.size() / 3;
+        stats.misses = 0;
+        stats.vertices = 0;
+
+        std::vector<unsigned char> misses = SimulateCache(indices, vertexCount, cacheSize);
+        for (size_t t = 0; t < misses.size(); t++)
+            stats.misses += misses[t];
+
+        std::vector<char> used(vertexCount, 0);
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (!used[indices[i]]) {
+                used[indices[i]] = 1;
+                stats.vertices++;
+            }
+        }
+        return stats;
+    }
+
+    std::vector<GLuint> OptimizeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        if (triangleCount == 0)
+            return result;
+
+        // triangles around every vertex
+        std::vector<GLuint> offsets(vertexCount + 1, 0);
+        for (size_t i = 0; i < indices.size(); i++)
+            offsets[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        std::vector<GLuint> adjacency(indices.size());
+        std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+
+        // triangles not emitted yet around every vertex
+        std::vector<unsigned int> live(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            live[v] = offsets[v + 1] - offsets[v];
+
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<GLuint> deadEnd;
+        std::vector<GLuint> candidates;
+        unsigned int time = cacheSize + 1;
+        size_t cursor = 0;
+
+        // first fanning vertex: the first one still used
+        long long fanning = -1;
+        while (cursor < vertexCount && fanning < 0) {
+            if (live[cursor] > 0)
+                fanning = (long long)cursor;
+            cursor++;
+        }
+
+        while (fanning >= 0) {
+            GLuint f = (GLuint)fanning;
+            candidates.clear();
+
+            // emit every remaining triangle around the fanning vertex
+            for (GLuint k = offsets[f]; k < offsets[f + 1]; k++) {
+                GLuint t = adjacency[k];
+                if (emitted[t])
+                    continue;
+                emitted[t] = 1;
+                for (int c = 0; c < 3; c++) {
+                    GLuint v = indices[3 * t + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // next fanning vertex: the candidate that stays longest in the cache after its fan
+            fanning = -1;
+            int bestPriority = -1;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                GLuint v = candidates[i];
+                if (live[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                    priority = (int)(time - cacheTime[v]);
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    fanning = v;
+                }
+            }
+
+            // dead end: go back to a recently used vertex, then scan forward for any live one
+            while (fanning < 0 && !deadEnd.empty()) {
+                GLuint v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    fanning = v;
+            }
+            while (fanning < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0)
+                    fanning = (long long)cursor;
+                cursor++;
+            }
+        }
+
+        return result;
+    }
+
+    std::vector<GLuint> OptimizeOverdraw(const std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices,
+        unsigned int cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return indices;
+
+        std::vector<unsigned char> misses = SimulateCache(indices, vertices.size(), cacheSize);
+
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        std::vector<Cluster> clusters;
+        std::vector<glm::vec3> clusterCenter;
+        std::vector<glm::vec3> clusterNormal;
+        std::vector<float> clusterArea;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (t == 0 || misses[t] == 3) {
+                Cluster cluster = { t, 0, 0.0f };
+                clusters.push_back(cluster);
+                clusterCenter.push_back(glm::vec3(0.0f));
+                clusterNormal.push_back(glm::vec3(0.0f));
+                clusterArea.push_back(0.0f);
+            }
+            clusters.back().triangleCount++;
+
+            glm::vec3 p0 = vertices[indices[3 * t + 0]].Position;
+            glm::vec3 p1 = vertices[indices[3 * t + 1]].Position;
+            glm::vec3 p2 = vertices[indices[3 * t + 2]].Position;
+            // area weighted, the cross product length is twice the area
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+            clusterCenter.back() += centroid * area;
+            clusterNormal.back() += normal;
+            clusterArea.back() += area;
+            meshCenter += centroid * area;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+
+        for (size_t c = 0; c < clusters.size(); c++) {
+            float normalLength = glm::length(clusterNormal[c]);
+            if (clusterArea[c] <= 0.0f || normalLength <= 0.0f)
+                continue;
+            glm::vec3 center = clusterCenter[c] / clusterArea[c];
+            clusters[c].sortKey = glm::dot(center - meshCenter, clusterNormal[c] / normalLength);
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (size_t c = 0; c < clusters.size(); c++) {
+            result.insert(result.end(), indices.begin() + 3 * clusters[c].firstTriangle,
+                indices.begin() + 3 * (clusters[c].firstTriangle + clusters[c].triangleCount));
+        }
+        return result;
+    }
+
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices) {
+        const GLuint UNUSED = 0xffffffffu;
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<gps::Vertex> ordered;
+        ordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint v = indices[i];
+            if (remap[v] == UNUSED) {
+                remap[v] = (GLuint)ordered.size();
+                ordered.push_back(vertices[v]);
+            }
+            indices[i] = remap[v];
+        }
+        vertices.swap(ordered);
+    }
+
+    void SplitMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices, size_t maxVertices,
+        std::vector<std::vector<gps::Vertex> >& chunkVertices, std::vector<std::vector<GLuint> >& chunkIndices) {
+        chunkVertices.clear();
+        chunkIndices.clear();
+        if (vertices.size() <= maxVertices) {
+            chunkVertices.push_back(vertices);
+            chunkIndices.push_back(indices);
+            return;
+        }
+
+        // remap[v] is the index of v in the current chunk, valid when chunkOf[v] is the current chunk
+        std::vector<GLuint> remap(vertices.size());
+        std::vector<size_t> chunkOf(vertices.size(), (size_t)-1);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            size_t chunk = chunkVertices.size() - 1;
+            int newVertices = 0;
+            for (int c = 0; c < 3; c++) {
+                if (chunkVertices.empty() || chunkOf[indices[t + c]] != chunk)
+                    newVertices++;
+            }
+            if (chunkVertices.empty() || chunkVertices.back().size() + newVertices > maxVertices) {
+                chunkVertices.push_back(std::vector<gps::Vertex>());
+                chunkIndices.push_back(std::vector<GLuint>());
+                chunk = chunkVertices.size() - 1;
+            }
+
+            for (int c = 0; c < 3; c++) {
+                GLuint v = indices[t + c];
+                if (chunkOf[v] != chunk) {
+                    chunkOf[v] = chunk;
+                    remap[v] = (GLuint)chunkVertices.back().size();
+                    chunkVertices.back().push_back(vertices[v]);
+                }
+                chunkIndices.back().push_back(remap[v]);
+            }
+        }
+    }
+
+    void OptimizeMesh(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<gps::MeshLod>& lods) {
+        for (size_t l = 0; l < lods.size(); l++) {
+            std::vector<GLuint>::iterator first = indices.begin() + lods[l].indexOffset;
+            std::vector<GLuint> range(first, first + lods[l].indexCount);
+            range = OptimizeVertexCache(range, vertices.size());
+            range = OptimizeOverdraw(range, vertices);
+            std::copy(range.begin(), range.end(), first);
+        }
+        // the levels are stored finest first, so vertices end up in the order of the full mesh
+        OptimizeVertexFetch(vertices, indices);
+    }
+}
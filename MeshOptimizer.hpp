@@ -0,0 +1,49 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Post-transform cache behaviour of an index buffer, simulated with a FIFO cache
+    struct VertexCacheStats {
+        size_t triangles;
+        // referenced vertices
+        size_t vertices;
+        size_t misses;
+
+        // average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+        float getAcmr() const;
+        // average transform to vertex ratio, transformed vertices per vertex (1 is optimal)
+        float getAtvr() const;
+    };
+
+    const unsigned int VERTEX_CACHE_SIZE = 16;
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+        unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Tipsify (Sander et al. 2007) triangle order for a post-transform cache of cacheSize entries
+    std::vector<GLuint> OptimizeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+        unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Splits a cache optimized index buffer into clusters where the order jumps to a new fan
+    // (all three vertices missing the cache) and draws the clusters facing away from the
+    // mesh center first, so they occlude the inner ones and early-Z rejects more fragments
+    std::vector<GLuint> OptimizeOverdraw(const std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices,
+        unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Reorders the vertices by first use in indices (dropping unused ones) and remaps the indices
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Splits a mesh into chunks of at most maxVertices vertices, keeping the triangle order
+    void SplitMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices, size_t maxVertices,
+        std::vector<std::vector<gps::Vertex> >& chunkVertices, std::vector<std::vector<GLuint> >& chunkIndices);
+
+    // Runs the cache, overdraw and vertex fetch stages on every level of detail of a cooked mesh
+    void OptimizeMesh(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<gps::MeshLod>& lods);
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,354 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+        // symmetric 4x4 matrix of the plane equations, plus the total weight of the planes
+        struct Quadric {
+            double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+            double weight;
+        };
+
+        void ClearQuadric(Quadric& q) {
+            memset(&q, 0, sizeof(Quadric));
+        }
+
+        void AddPlane(Quadric& q, double a, double b, double c, double d, double weight) {
+            q.xx += weight * a * a; q.xy += weight * a * b; q.xz += weight * a * c; q.xw += weight * a * d;
+            q.yy += weight * b * b; q.yz += weight * b * c; q.yw += weight * b * d;
+            q.zz += weight * c * c; q.zw += weight * c * d;
+            q.ww += weight * d * d;
+            q.weight += weight;
+        }
+
+        void AddQuadric(Quadric& q, const Quadric& other) {
+            q.xx += other.xx; q.xy += other.xy; q.xz += other.xz; q.xw += other.xw;
+            q.yy += other.yy; q.yz += other.yz; q.yw += other.yw;
+            q.zz += other.zz; q.zw += other.zw;
+            q.ww += other.ww;
+            q.weight += other.weight;
+        }
+
+        // mean squared distance of p to the planes of the quadric
+        double EvaluateQuadric(const Quadric& q, const glm::vec3& p) {
+            double x = p.x, y = p.y, z = p.z;
+            double error = q.xx * x * x + 2 * q.xy * x * y + 2 * q.xz * x * z + 2 * q.xw * x
+                + q.yy * y * y + 2 * q.yz * y * z + 2 * q.yw * y
+                + q.zz * z * z + 2 * q.zw * z
+                + q.ww;
+            return q.weight > 0.0 ? std::fabs(error) / q.weight : 0.0;
+        }
+
+        struct Collapse {
+            GLuint from;
+            GLuint to;
+            double cost;
+        };
+
+        unsigned long long EdgeKey(GLuint a, GLuint b) {
+            if (a > b)
+                std::swap(a, b);
+            return ((unsigned long long)a << 32) | b;
+        }
+
+        struct VertexKeyHash {
+            const std::vector<gps::Vertex>* vertices;
+            size_t operator()(GLuint index) const {
+                const gps::Vertex& v = (*vertices)[index];
+                unsigned int words[8];
+                memcpy(words, &v, sizeof(words));
+                size_t hash = 2166136261u;
+                for (int i = 0; i < 8; i++)
+                    hash = (hash ^ words[i]) * 16777619u;
+                return hash;
+            }
+        };
+
+        struct VertexKeyEqual {
+            const std::vector<gps::Vertex>* vertices;
+            bool operator()(GLuint a, GLuint b) const {
+                return memcmp(&(*vertices)[a], &(*vertices)[b], sizeof(gps::Vertex)) == 0;
+            }
+        };
+
+        struct PositionKeyHash {
+            const std::vector<gps::Vertex>* vertices;
+            size_t operator()(GLuint index) const {
+                unsigned int words[3];
+                memcpy(words, &(*vertices)[index].Position, sizeof(words));
+                return ((size_t)words[0] * 73856093u) ^ ((size_t)words[1] * 19349663u) ^ ((size_t)words[2] * 83492791u);
+            }
+        };
+
+        struct PositionKeyEqual {
+            const std::vector<gps::Vertex>* vertices;
+            bool operator()(GLuint a, GLuint b) const {
+                return (*vertices)[a].Position == (*vertices)[b].Position;
+            }
+        };
+    }
+
+    void WeldVertices(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices) {
+        VertexKeyHash hash = { &vertices };
+        VertexKeyEqual equal = { &vertices };
+        std::unordered_map<GLuint, GLuint, VertexKeyHash, VertexKeyEqual> unique(vertices.size(), hash, equal);
+
+        std::vector<gps::Vertex> welded;
+        std::vector<GLuint> remap(vertices.size());
+        for (GLuint i = 0; i < vertices.size(); i++) {
+            std::unordered_map<GLuint, GLuint, VertexKeyHash, VertexKeyEqual>::iterator found = unique.find(i);
+            if (found != unique.end()) {
+                remap[i] = remap[found->second];
+            }
+            else {
+                unique[i] = i;
+                remap[i] = (GLuint)welded.size();
+                welded.push_back(vertices[i]);
+            }
+        }
+
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+        vertices.swap(welded);
+    }
+
+    std::vector<GLuint> SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, float& resultError) {
+        size_t vertexCount = vertices.size();
+        std::vector<GLuint> result(indices);
+        resultError = 0.0f;
+        if (vertexCount == 0 || indices.size() <= targetIndexCount)
+            return result;
+
+        // vertices sharing a position (UV/normal seams) are collapsed together, through their root
+        PositionKeyHash positionHash = { &vertices };
+        PositionKeyEqual positionEqual = { &vertices };
+        std::unordered_map<GLuint, GLuint, PositionKeyHash, PositionKeyEqual> positions(vertexCount, positionHash, positionEqual);
+        std::vector<GLuint> root(vertexCount);
+        for (GLuint i = 0; i < vertexCount; i++) {
+            std::unordered_map<GLuint, GLuint, PositionKeyHash, PositionKeyEqual>::iterator found = positions.find(i);
+            if (found != positions.end()) {
+                root[i] = found->second;
+            }
+            else {
+                positions[i] = i;
+                root[i] = i;
+            }
+        }
+
+        // area weighted plane quadrics, and open edges (used by one triangle) to lock borders
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            ClearQuadric(quadrics[i]);
+        std::unordered_map<unsigned long long, int> edgeUse;
+        for (size_t t = 0; t + 2 < result.size(); t += 3) {
+            GLuint r[3] = { root[result[t]], root[result[t + 1]], root[result[t + 2]] };
+            glm::vec3 p0 = vertices[r[0]].Position, p1 = vertices[r[1]].Position, p2 = vertices[r[2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normal /= length;
+                double d = -glm::dot(normal, p0);
+                for (int c = 0; c < 3; c++)
+                    AddPlane(quadrics[r[c]], normal.x, normal.y, normal.z, d, length * 0.5);
+            }
+            for (int c = 0; c < 3; c++)
+                edgeUse[EdgeKey(r[c], r[(c + 1) % 3])]++;
+        }
+        std::vector<char> locked(vertexCount, 0);
+        for (std::unordered_map<unsigned long long, int>::iterator it = edgeUse.begin(); it != edgeUse.end(); ++it) {
+            if (it->second == 1) {
+                locked[(GLuint)(it->first >> 32)] = 1;
+                locked[(GLuint)(it->first & 0xffffffffu)] = 1;
+            }
+        }
+
+        double maxCost = 0.0;
+        std::vector<GLuint> triangleOffsets(vertexCount + 1);
+        std::vector<GLuint> adjacency;
+        std::vector<Collapse> collapses;
+        std::vector<char> touched(vertexCount);
+        std::vector<GLuint> wedgeRemap(vertexCount);
+
+        for (int pass = 0; pass < 100 && result.size() > targetIndexCount; pass++) {
+            size_t triangleCount = result.size() / 3;
+
+            // triangles around every root
+            std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+            for (size_t i = 0; i < result.size(); i++)
+                triangleOffsets[root[result[i]] + 1]++;
+            for (size_t i = 0; i < vertexCount; i++)
+                triangleOffsets[i + 1] += triangleOffsets[i];
+            adjacency.resize(result.size());
+            std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacency[fill[root[result[i]]]++] = (GLuint)(i / 3);
+
+            // every edge in both directions, cost of moving "from" onto "to"
+            collapses.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int c = 0; c < 3; c++) {
+                    GLuint a = root[result[3 * t + c]];
+                    GLuint b = root[result[3 * t + (c + 1) % 3]];
+                    if (a == b)
+                        continue;
+                    if (!locked[a]) {
+                        Collapse collapse = { a, b, EvaluateQuadric(quadrics[a], vertices[b].Position) };
+                        collapses.push_back(collapse);
+                    }
+                    if (!locked[b]) {
+                        Collapse collapse = { b, a, EvaluateQuadric(quadrics[b], vertices[a].Position) };
+                        collapses.push_back(collapse);
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                return x.cost < y.cost;
+            });
+
+            std::fill(touched.begin(), touched.end(), 0);
+            for (GLuint i = 0; i < vertexCount; i++)
+                wedgeRemap[i] = i;
+
+            size_t removedTriangles = 0;
+            size_t applied = 0;
+            for (size_t c = 0; c < collapses.size(); c++) {
+                if ((triangleCount - removedTriangles) * 3 <= targetIndexCount)
+                    break;
+
+                GLuint from = collapses[c].from;
+                GLuint to = collapses[c].to;
+                if (touched[from] || touched[to])
+                    continue;
+
+                // map every wedge of "from" to the wedge of "to" it shares a triangle with,
+                // a wedge without partner means the edge crosses a seam
+                bool valid = true;
+                size_t collapsing = 0;
+                for (GLuint k = triangleOffsets[from]; k < triangleOffsets[from + 1] && valid; k++) {
+                    GLuint t = adjacency[k];
+                    int fromCorner = -1, toCorner = -1;
+                    for (int corner = 0; corner < 3; corner++) {
+                        GLuint r = root[result[3 * t + corner]];
+                        if (r == from)
+                            fromCorner = corner;
+                        else if (r == to)
+                            toCorner = corner;
+                    }
+                    if (toCorner < 0)
+                        continue;
+                    collapsing++;
+                    GLuint fromWedge = result[3 * t + fromCorner];
+                    GLuint toWedge = result[3 * t + toCorner];
+                    if (wedgeRemap[fromWedge] != fromWedge && wedgeRemap[fromWedge] != toWedge)
+                        valid = false;
+                    wedgeRemap[fromWedge] = toWedge;
+                }
+
+                for (GLuint k = triangleOffsets[from]; k < triangleOffsets[from + 1] && valid; k++) {
+                    GLuint t = adjacency[k];
+                    glm::vec3 corners[3];
+                    glm::vec3 moved[3];
+                    bool hasTo = false;
+                    for (int corner = 0; corner < 3; corner++) {
+                        GLuint wedge = result[3 * t + corner];
+                        GLuint r = root[wedge];
+                        hasTo = hasTo || r == to;
+                        corners[corner] = vertices[r].Position;
+                        moved[corner] = r == from ? vertices[to].Position : corners[corner];
+                        if (r == from && wedgeRemap[wedge] == wedge)
+                            valid = false;
+                    }
+                    if (hasTo || !valid)
+                        continue;
+                    // reject collapses that flip a remaining triangle
+                    glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                    if (glm::dot(before, after) <= 0.0f)
+                        valid = false;
+                }
+
+                if (!valid || collapsing == 0) {
+                    // undo the partial wedge mapping
+                    for (GLuint k = triangleOffsets[from]; k < triangleOffsets[from + 1]; k++) {
+                        GLuint t = adjacency[k];
+                        for (int corner = 0; corner < 3; corner++) {
+                            GLuint wedge = result[3 * t + corner];
+                            if (root[wedge] == from)
+                                wedgeRemap[wedge] = wedge;
+                        }
+                    }
+                    continue;
+                }
+
+                // neighbours are frozen for the rest of the pass so the flip tests above stay valid
+                for (GLuint k = triangleOffsets[from]; k < triangleOffsets[from + 1]; k++) {
+                    GLuint t = adjacency[k];
+                    for (int corner = 0; corner < 3; corner++)
+                        touched[root[result[3 * t + corner]]] = 1;
+                }
+                AddQuadric(quadrics[to], quadrics[from]);
+                maxCost = std::max(maxCost, collapses[c].cost);
+                removedTriangles += collapsing;
+                applied++;
+            }
+
+            if (applied == 0)
+                break;
+
+            // apply the collapses and drop the triangles that became degenerate
+            size_t write = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                GLuint a = wedgeRemap[result[3 * t + 0]];
+                GLuint b = wedgeRemap[result[3 * t + 1]];
+                GLuint c = wedgeRemap[result[3 * t + 2]];
+                if (root[a] == root[b] || root[b] == root[c] || root[a] == root[c])
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        resultError = (float)std::sqrt(maxCost);
+        return result;
+    }
+
+    void BuildLods(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices,
+        std::vector<gps::MeshLod>& lods, int levelCount) {
+        lods.clear();
+        gps::MeshLod base;
+        base.indexOffset = 0;
+        base.indexCount = (GLuint)indices.size();
+        base.error = 0.0f;
+        lods.push_back(base);
+
+        std::vector<GLuint> current(indices);
+        for (int level = 1; level < levelCount; level++) {
+            size_t target = (base.indexCount >> level) / 3 * 3;
+            float error = 0.0f;
+            std::vector<GLuint> simplified = SimplifyMesh(vertices, current, target, error);
+
+            // not worth a level if it barely removes anything
+            if (simplified.empty() || simplified.size() > current.size() * 9 / 10)
+                break;
+
+            gps::MeshLod lod;
+            lod.indexOffset = (GLuint)indices.size();
+            lod.indexCount = (GLuint)simplified.size();
+            // errors of the cascaded simplifications add up
+            lod.error = lods.back().error + error;
+            lods.push_back(lod);
+
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            current.swap(simplified);
+        }
+    }
+}
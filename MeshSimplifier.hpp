@@ -0,0 +1,28 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Merges vertices with identical position, normal and texture coordinates
+    void WeldVertices(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Quadric error metric simplification by half-edge collapses.
+    // The vertex buffer is left untouched, only a smaller index buffer is returned, so all
+    // levels of detail can share one VBO. Vertices on open borders are never moved and
+    // collapses that would tear an UV/normal seam are rejected.
+    // resultError is the RMS distance to the original planes of the most expensive collapse,
+    // in the units of the vertex positions. An estimate, not a bound on the deviation.
+    std::vector<GLuint> SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, float& resultError);
+
+    // Appends up to levelCount - 1 simplified versions of the (single level) index buffer
+    // and describes every level in lods, lods[0] being the original mesh
+    void BuildLods(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices,
+        std::vector<gps::MeshLod>& lods, int levelCount = 4);
+}
+
+#endif /* MeshSimplifier_hpp */
@@ -1,7 +1,33 @@
 #include "Model3D.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+#include "CpuProfiler.hpp"
+
+#include <cfloat>
 
 namespace gps {
 
+	namespace {
+		// Axis aligned box and a bounding sphere around its center, tightened to the farthest vertex
+		void ComputeBoundingVolumes(gps::MeshData& data) {
+			data.bounds.min = glm::vec3(FLT_MAX);
+			data.bounds.max = glm::vec3(-FLT_MAX);
+			for (size_t v = 0; v < data.vertices.size(); v++) {
+				data.bounds.min = glm::min(data.bounds.min, data.vertices[v].Position);
+				data.bounds.max = glm::max(data.bounds.max, data.vertices[v].Position);
+			}
+
+			data.sphere.center = (data.bounds.min + data.bounds.max) * 0.5f;
+			data.sphere.radius = 0.0f;
+			for (size_t v = 0; v < data.vertices.size(); v++) {
+				data.sphere.radius = glm::max(data.sphere.radius, glm::length(data.vertices[v].Position - data.sphere.center));
+			}
+			if (data.vertices.empty()) {
+				data.bounds.min = data.bounds.max = data.sphere.center = glm::vec3(0.0f);
+			}
+		}
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
@@ -20,10 +46,63 @@ namespace gps {
 			meshes[i].Draw(shaderProgram);
 	}
 
-	// Does the parsing of the .obj file and fills in the data structure
+	void Model3D::setVertexFormat(gps::VERTEX_FORMAT format) {
+		vertexFormat = format;
+	}
+
+	std::vector<gps::Mesh>& Model3D::getMeshes() {
+		return meshes;
+	}
+
+	// Reads the cooked meshes from the cache, or parses and cooks the .obj file, then uploads them
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+		CPU_SCOPE("Model3D::ReadOBJ");
 
         std::cout << "Loading : " << fileName << std::endl;
+		std::vector<gps::MeshData> meshData;
+		std::string cachePath = gps::MeshCache::getCachePath(fileName);
+		unsigned long long sourceHash = 0;
+		bool hashed = gps::MeshCache::HashSource(fileName, basePath, sourceHash);
+
+		if (hashed && gps::MeshCache::Load(cachePath, sourceHash, meshData)) {
+			std::cout << "Loaded from cache : " << cachePath << std::endl;
+		}
+		else {
+			ParseOBJ(fileName, basePath, meshData);
+			if (hashed)
+				gps::MeshCache::Save(cachePath, sourceHash, meshData);
+		}
+
+		gps::VertexFormatError formatError = { 0.0f, 0.0f, 0.0f };
+		size_t vertexCount = 0;
+		for (size_t m = 0; m < meshData.size(); m++) {
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < meshData[m].textures.size(); t++)
+				textures.push_back(LoadTexture(meshData[m].textures[t].path, meshData[m].textures[t].type));
+
+			meshes.push_back(gps::Mesh(meshData[m].vertices, meshData[m].indices, textures, meshData[m].lods, vertexFormat));
+			meshes.back().bounds = meshData[m].bounds;
+			meshes.back().sphere = meshData[m].sphere;
+
+			gps::VertexFormatError error = gps::MeasureVertexError(meshData[m].vertices, vertexFormat);
+			formatError.position = glm::max(formatError.position, error.position);
+			formatError.normalDegrees = glm::max(formatError.normalDegrees, error.normalDegrees);
+			formatError.texCoords = glm::max(formatError.texCoords, error.texCoords);
+			vertexCount += meshData[m].vertices.size();
+		}
+
+		if (vertexFormat != gps::VERTEX_FORMAT_FULL) {
+			std::cout << "Vertex format " << gps::getVertexFormatName(vertexFormat) << " : "
+				<< vertexCount * sizeof(gps::Vertex) / 1024 << " KB -> " << vertexCount * gps::getVertexSize(vertexFormat) / 1024 << " KB"
+				<< ", max error position " << formatError.position << ", normal " << formatError.normalDegrees
+				<< " deg, uv " << formatError.texCoords << std::endl;
+		}
+	}
+
+	// Does the parsing of the .obj file and cooks every shape into an indexed mesh with its levels of detail
+	void Model3D::ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData){
+		CPU_SCOPE("Model3D::ParseOBJ");
+
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
@@ -43,6 +122,10 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		// post-transform cache efficiency of the full detail levels, before and after reordering
+		gps::VertexCacheStats cacheBefore = { 0, 0, 0 };
+		gps::VertexCacheStats cacheAfter = { 0, 0, 0 };
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 			std::vector<gps::Vertex> vertices;
@@ -108,7 +191,9 @@ namespace gps {
 					if (!ambientTexturePath.empty())
 					{
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "ambientTexture";
+						currentTexture.path = basePath + ambientTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -117,7 +202,9 @@ namespace gps {
 					if (!diffuseTexturePath.empty())
 					{
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = basePath + diffuseTexturePath;
 						textures.push_back(currentTexture);
 					}
 
@@ -126,14 +213,57 @@ namespace gps {
 					if (!specularTexturePath.empty())
 					{
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+						currentTexture.id = 0;
+						currentTexture.type = "specularTexture";
+						currentTexture.path = basePath + specularTexturePath;
+						textures.push_back(currentTexture);
+					}
+
+					//alpha (cutout) texture, drawn with alpha testing
+					std::string alphaTexturePath = materials[materialId].alpha_texname;
+					if (!alphaTexturePath.empty())
+					{
+						gps::Texture currentTexture;
+						currentTexture.id = 0;
+						currentTexture.type = "alphaTexture";
+						currentTexture.path = basePath + alphaTexturePath;
 						textures.push_back(currentTexture);
 					}
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			// the faces come in with their own vertices, share them before simplifying
+			gps::WeldVertices(vertices, indices);
+
+			// big shapes become several meshes, so every mesh can use 16-bit indices
+			std::vector<std::vector<gps::Vertex> > chunkVertices;
+			std::vector<std::vector<GLuint> > chunkIndices;
+			gps::SplitMesh(vertices, indices, gps::MAX_16BIT_VERTICES, chunkVertices, chunkIndices);
+
+			for (size_t c = 0; c < chunkVertices.size(); c++) {
+				gps::MeshData data;
+				data.vertices.swap(chunkVertices[c]);
+				data.indices.swap(chunkIndices[c]);
+				gps::BuildLods(data.vertices, data.indices, data.lods);
+
+				std::vector<GLuint> fullDetail(data.indices.begin(), data.indices.begin() + data.lods[0].indexCount);
+				gps::VertexCacheStats stats = gps::AnalyzeVertexCache(fullDetail, data.vertices.size());
+				cacheBefore.triangles += stats.triangles; cacheBefore.vertices += stats.vertices; cacheBefore.misses += stats.misses;
+
+				gps::OptimizeMesh(data.vertices, data.indices, data.lods);
+
+				fullDetail.assign(data.indices.begin(), data.indices.begin() + data.lods[0].indexCount);
+				stats = gps::AnalyzeVertexCache(fullDetail, data.vertices.size());
+				cacheAfter.triangles += stats.triangles; cacheAfter.vertices += stats.vertices; cacheAfter.misses += stats.misses;
+
+				data.textures = textures;
+				ComputeBoundingVolumes(data);
+				meshData.push_back(data);
+			}
 		}
+
+		std::cout << "Vertex cache ACMR : " << cacheBefore.getAcmr() << " -> " << cacheAfter.getAcmr()
+			<< ", ATVR : " << cacheBefore.getAtvr() << " -> " << cacheAfter.getAtvr() << std::endl;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
@@ -159,6 +289,7 @@ namespace gps {
 
 	// Reads the pixel data from an image file and loads it into the video memory
 	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		CPU_SCOPE("Model3D::ReadTextureFromFile");
 		int x, y, n;
 		int force_channels = 4;
 		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
@@ -228,6 +359,10 @@ namespace gps {
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+            GLuint positionVBO = meshes.at(i).getBuffers().positionVBO;
+            GLuint depthVAO = meshes.at(i).getBuffers().depthVAO;
+            glDeleteBuffers(1, &positionVBO);
+            glDeleteVertexArrays(1, &depthVAO);
         }
 	}
 }
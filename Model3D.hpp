@@ -2,6 +2,7 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -24,15 +25,25 @@ namespace gps {
 
 		void Draw(gps::Shader shaderProgram);
 
+		// GPU vertex layout of the meshes loaded afterwards
+		void setVertexFormat(gps::VERTEX_FORMAT format);
+
+		// Component meshes, e.g. for packing them into a StaticBatch
+		std::vector<gps::Mesh>& getMeshes();
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		gps::VERTEX_FORMAT vertexFormat = gps::VERTEX_FORMAT_FULL;
 
-		// Does the parsing of the .obj file and fills in the data structure
+		// Fills in the data structure, from the mesh cache when it is up to date
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Does the parsing of the .obj file and cooks the meshes
+		void ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData);
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
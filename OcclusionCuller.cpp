@@ -0,0 +1,352 @@
+#include "OcclusionCuller.hpp"
+#include "CpuProfiler.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+        // pixels processed per SIMD step, the depth buffer rows are padded to a multiple of it
+#if defined(OCCLUSION_AVX2)
+        const int LANES = 8;
+#else
+        const int LANES = 4;
+#endif
+        // clip space w below this is treated as crossing the near plane
+        const float NEAR_W = 1e-3f;
+    }
+
+    void OcclusionCuller::Init(int width, int height, unsigned int threadCount) {
+        // whole tiles, and rows that are a multiple of the SIMD width
+        this->width = (width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+        this->height = (height + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+        this->tilesX = this->width / TILE_SIZE;
+        this->tilesY = this->height / TILE_SIZE;
+        this->threadCount = threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+        // every band is at least one tile row high
+        this->threadCount = std::min(this->threadCount, (unsigned int)tilesY);
+
+        depthBuffer.assign(this->width * this->height, 1.0f);
+        tileMaxDepth.assign(tilesX * tilesY, 1.0f);
+    }
+
+    void OcclusionCuller::AddOccluder(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& modelMatrix) {
+        GLuint baseVertex = (GLuint)occluderPositions.size();
+        for (size_t i = 0; i < vertices.size(); i++)
+            occluderPositions.push_back(glm::vec3(modelMatrix * glm::vec4(vertices[i].Position, 1.0f)));
+        for (size_t i = 0; i < indices.size(); i++)
+            occluderIndices.push_back(baseVertex + indices[i]);
+    }
+
+    void OcclusionCuller::ClearOccluders() {
+        occluderPositions.clear();
+        occluderIndices.clear();
+    }
+
+    size_t OcclusionCuller::getOccluderTriangleCount() const {
+        return occluderIndices.size() / 3;
+    }
+
+    void OcclusionCuller::SetupTriangles(size_t firstTriangle, size_t lastTriangle, std::vector<ScreenTriangle>& output) const {
+        for (size_t t = firstTriangle; t < lastTriangle; t++) {
+            glm::vec3 screen[3];
+            bool clipped = false;
+            for (int v = 0; v < 3; v++) {
+                glm::vec4 clip = viewProjection * glm::vec4(occluderPositions[occluderIndices[3 * t + v]], 1.0f);
+                // dropping triangles that cross the near plane only loses occlusion, never hides anything
+                if (clip.w < NEAR_W) {
+                    clipped = true;
+                    break;
+                }
+                float invW = 1.0f / clip.w;
+                screen[v] = glm::vec3((clip.x * invW * 0.5f + 0.5f) * width,
+                    (clip.y * invW * 0.5f + 0.5f) * height,
+                    clip.z * invW * 0.5f + 0.5f);
+            }
+            if (clipped)
+                continue;
+
+            // counter clockwise triangles are front facing, like glFrontFace(GL_CCW)
+            float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+            if (area <= 0.0f)
+                continue;
+
+            ScreenTriangle tri;
+            tri.minX = std::max(0, (int)std::floor(std::min(screen[0].x, std::min(screen[1].x, screen[2].x))));
+            tri.maxX = std::min(width - 1, (int)std::ceil(std::max(screen[0].x, std::max(screen[1].x, screen[2].x))));
+            tri.minY = std::max(0, (int)std::floor(std::min(screen[0].y, std::min(screen[1].y, screen[2].y))));
+            tri.maxY = std::min(height - 1, (int)std::ceil(std::max(screen[0].y, std::max(screen[1].y, screen[2].y))));
+            if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+                continue;
+
+            for (int e = 0; e < 3; e++) {
+                const glm::vec3& a = screen[e];
+                const glm::vec3& b = screen[(e + 1) % 3];
+                tri.edgeA[e] = a.y - b.y;
+                tri.edgeB[e] = b.x - a.x;
+                tri.edgeC[e] = a.x * b.y - a.y * b.x;
+            }
+
+            // z is affine in screen space after the perspective divide
+            glm::vec3 e1 = screen[1] - screen[0];
+            glm::vec3 e2 = screen[2] - screen[0];
+            tri.depthA = (e1.z * e2.y - e2.z * e1.y) / area;
+            tri.depthB = (e2.z * e1.x - e1.z * e2.x) / area;
+            tri.depthC = screen[0].z - tri.depthA * screen[0].x - tri.depthB * screen[0].y;
+
+            output.push_back(tri);
+        }
+    }
+
+    void OcclusionCuller::RasterizeBand(int bandMinY, int bandMaxY) {
+        for (int y = bandMinY; y <= bandMaxY; y++)
+            std::fill(depthBuffer.begin() + y * width, depthBuffer.begin() + (y + 1) * width, 1.0f);
+
+        for (size_t t = 0; t < triangles.size(); t++) {
+            const ScreenTriangle& tri = triangles[t];
+            int minY = std::max(tri.minY, bandMinY);
+            int maxY = std::min(tri.maxY, bandMaxY);
+            if (minY > maxY)
+                continue;
+            int minX = tri.minX / LANES * LANES;
+
+            for (int y = minY; y <= maxY; y++) {
+                float py = y + 0.5f;
+                float* row = &depthBuffer[y * width];
+                int x = minX;
+
+#if defined(OCCLUSION_AVX2)
+                __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+                for (; x <= tri.maxX; x += LANES) {
+                    __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+                    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++) {
+                        __m256 edge = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(tri.edgeA[e])), _mm256_set1_ps(tri.edgeB[e] * py + tri.edgeC[e]));
+                        inside = _mm256_and_ps(inside, _mm256_cmp_ps(edge, _mm256_setzero_ps(), _CMP_GE_OQ));
+                    }
+                    if (_mm256_movemask_ps(inside) == 0)
+                        continue;
+                    __m256 depth = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(tri.depthA)), _mm256_set1_ps(tri.depthB * py + tri.depthC));
+                    __m256 stored = _mm256_loadu_ps(row + x);
+                    _mm256_storeu_ps(row + x, _mm256_blendv_ps(stored, _mm256_min_ps(stored, depth), inside));
+                }
+#elif defined(OCCLUSION_SSE)
+                __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                for (; x <= tri.maxX; x += LANES) {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++) {
+                        __m128 edge = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(tri.edgeA[e])), _mm_set1_ps(tri.edgeB[e] * py + tri.edgeC[e]));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+                    }
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 depth = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(tri.depthA)), _mm_set1_ps(tri.depthB * py + tri.depthC));
+                    __m128 stored = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(stored, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+                }
+#else
+                for (; x <= tri.maxX; x++) {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++)
+                        inside = inside && tri.edgeA[e] * px + tri.edgeB[e] * py + tri.edgeC[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], tri.depthA * px + tri.depthB * py + tri.depthC);
+                }
+#endif
+            }
+        }
+
+        // max depth of the tiles of this band
+        for (int ty = bandMinY / TILE_SIZE; ty <= bandMaxY / TILE_SIZE; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                float maxDepth = 0.0f;
+                for (int y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; y++) {
+                    const float* row = &depthBuffer[y * width + tx * TILE_SIZE];
+                    for (int x = 0; x < TILE_SIZE; x++)
+                        maxDepth = std::max(maxDepth, row[x]);
+                }
+                tileMaxDepth[ty * tilesX + tx] = maxDepth;
+            }
+        }
+    }
+
+    void OcclusionCuller::Render(const glm::mat4& viewProjection) {
+        CPU_SCOPE("OcclusionCuller::Render");
+        this->viewProjection = viewProjection;
+
+        // triangle setup, split into one chunk per thread
+        size_t triangleCount = occluderIndices.size() / 3;
+        std::vector<std::vector<ScreenTriangle> > chunks(threadCount);
+        std::vector<std::future<void> > jobs;
+        size_t chunkSize = (triangleCount + threadCount - 1) / threadCount;
+        for (unsigned int i = 0; i < threadCount; i++) {
+            size_t first = std::min(triangleCount, i * chunkSize);
+            size_t last = std::min(triangleCount, first + chunkSize);
+            if (i + 1 == threadCount) {
+                SetupTriangles(first, last, chunks[i]);
+            }
+            else {
+                jobs.push_back(std::async(std::launch::async, [this, first, last, &chunks, i]() {
+                    SetupTriangles(first, last, chunks[i]);
+                }));
+            }
+        }
+        for (size_t i = 0; i < jobs.size(); i++)
+            jobs[i].get();
+        jobs.clear();
+
+        triangles.clear();
+        for (unsigned int i = 0; i < threadCount; i++)
+            triangles.insert(triangles.end(), chunks[i].begin(), chunks[i].end());
+
+        // rasterization, one band of whole tile rows per thread
+        int tileRowsPerBand = (tilesY + threadCount - 1) / threadCount;
+        for (unsigned int i = 0; i < threadCount; i++) {
+            int bandMinY = i * tileRowsPerBand * TILE_SIZE;
+            int bandMaxY = std::min(height, (int)(i + 1) * tileRowsPerBand * TILE_SIZE) - 1;
+            if (bandMinY > bandMaxY)
+                continue;
+            if (i + 1 == threadCount) {
+                RasterizeBand(bandMinY, bandMaxY);
+            }
+            else {
+                jobs.push_back(std::async(std::launch::async, [this, bandMinY, bandMaxY]() {
+                    RasterizeBand(bandMinY, bandMaxY);
+                }));
+            }
+        }
+        for (size_t i = 0; i < jobs.size(); i++)
+            jobs[i].get();
+    }
+
+    bool OcclusionCuller::isVisible(float cx, float cy, float cz, float ex, float ey, float ez) const {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearestDepth = FLT_MAX;
+
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 position(cx + ((corner & 1) ? ex : -ex),
+                cy + ((corner & 2) ? ey : -ey),
+                cz + ((corner & 4) ? ez : -ez), 1.0f);
+            glm::vec4 clip = viewProjection * position;
+            // boxes reaching the camera plane are never rejected
+            if (clip.w < NEAR_W)
+                return true;
+            float invW = 1.0f / clip.w;
+            float x = (clip.x * invW * 0.5f + 0.5f) * width;
+            float y = (clip.y * invW * 0.5f + 0.5f) * height;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearestDepth = std::min(nearestDepth, clip.z * invW * 0.5f + 0.5f);
+        }
+
+        int tileMinX = std::max(0, (int)std::floor(minX) / TILE_SIZE);
+        int tileMaxX = std::min(tilesX - 1, (int)std::floor(maxX) / TILE_SIZE);
+        int tileMinY = std::max(0, (int)std::floor(minY) / TILE_SIZE);
+        int tileMaxY = std::min(tilesY - 1, (int)std::floor(maxY) / TILE_SIZE);
+        if (tileMinX > tileMaxX || tileMinY > tileMaxY)
+            return true;
+
+        // visible as soon as one covered tile has something farther than the box
+        for (int ty = tileMinY; ty <= tileMaxY; ty++) {
+            for (int tx = tileMinX; tx <= tileMaxX; tx++) {
+                if (nearestDepth <= tileMaxDepth[ty * tilesX + tx])
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void OcclusionCuller::cullBoxes(const gps::BoxList& boxes, std::vector<unsigned char>& visible, gps::CullStats& stats) const {
+        for (size_t i = 0; i < boxes.size(); i++) {
+            if (!visible[i])
+                continue;
+            if (!isVisible(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i], boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i])) {
+                visible[i] = 0;
+                stats.occluded++;
+            }
+        }
+    }
+
+    int OcclusionCuller::getWidth() const {
+        return width;
+    }
+
+    int OcclusionCuller::getHeight() const {
+        return height;
+    }
+
+    const std::vector<float>& OcclusionCuller::getDepthBuffer() const {
+        return depthBuffer;
+    }
+
+    void OcclusionCuller::Benchmark(const gps::BoxList& boxes, const glm::mat4& projection, int frames) {
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (size_t i = 0; i < occluderPositions.size(); i++) {
+            boundsMin = glm::min(boundsMin, occluderPositions[i]);
+            boundsMax = glm::max(boundsMax, occluderPositions[i]);
+        }
+        if (occluderPositions.empty())
+            boundsMin = boundsMax = glm::vec3(0.0f);
+
+        std::mt19937 random(4321);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<unsigned char> visible;
+        gps::Frustum frustum;
+        gps::CullStats stats;
+        double renderMs = 0.0, testMs = 0.0;
+        unsigned int frustumVisible = 0;
+
+        for (int frame = 0; frame < frames; frame++) {
+            // eye height of a walking camera, looking roughly horizontally
+            glm::vec3 eye(glm::mix(boundsMin.x, boundsMax.x, unit(random)),
+                boundsMin.y + 2.0f + 10.0f * unit(random),
+                glm::mix(boundsMin.z, boundsMax.z, unit(random)));
+            float yaw = unit(random) * 6.2831853f;
+            glm::vec3 front(std::cos(yaw), 0.2f * (unit(random) - 0.5f), std::sin(yaw));
+            glm::mat4 viewProjectionMatrix = projection * glm::lookAt(eye, eye + front, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Render(viewProjectionMatrix);
+            std::chrono::steady_clock::time_point rendered = std::chrono::steady_clock::now();
+
+            frustum.extract(viewProjectionMatrix);
+            frustum.cullBoxes(boxes, visible);
+            for (size_t i = 0; i < visible.size(); i++)
+                frustumVisible += visible[i];
+            cullBoxes(boxes, visible, stats);
+            std::chrono::steady_clock::time_point tested = std::chrono::steady_clock::now();
+
+            renderMs += std::chrono::duration<double, std::milli>(rendered - start).count();
+            testMs += std::chrono::duration<double, std::milli>(tested - rendered).count();
+        }
+
+        std::cout << "Occlusion culling benchmark (" << width << "x" << height << ", " << threadCount << " threads)" << std::endl;
+        std::cout << "  occluder triangles : " << getOccluderTriangleCount() << std::endl;
+        std::cout << "  rasterization      : " << renderMs / frames << " ms/frame" << std::endl;
+        std::cout << "  box tests          : " << testMs / frames << " ms/frame (" << boxes.size() << " boxes)" << std::endl;
+        std::cout << "  culling rate       : " << (frustumVisible > 0 ? 100.0 * stats.occluded / frustumVisible : 0.0)
+            << "% of the frustum-visible boxes occluded" << std::endl;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+#include "Frustum.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Software occlusion culling: occluder triangles are rasterized on the CPU into a small
+    // depth buffer (SIMD, one horizontal band per thread), then a max-depth value per 8x8 tile
+    // is used to reject boxes that are completely behind the occluders.
+    // No GL calls are made, so it also runs without a context.
+    class OcclusionCuller
+    {
+    public:
+        void Init(int width = 320, int height = 192, unsigned int threadCount = 0);
+
+        // occluder geometry, kept in world space
+        void AddOccluder(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& modelMatrix);
+        void ClearOccluders();
+        size_t getOccluderTriangleCount() const;
+
+        // clears the depth buffer and rasterizes all occluders seen through viewProjection
+        void Render(const glm::mat4& viewProjection);
+
+        // false if the world space box is hidden behind the rendered occluders
+        bool isVisible(float cx, float cy, float cz, float ex, float ey, float ez) const;
+        // clears visible[i] for every box that is occluded, counts them in stats.occluded
+        void cullBoxes(const gps::BoxList& boxes, std::vector<unsigned char>& visible, gps::CullStats& stats) const;
+
+        int getWidth() const;
+        int getHeight() const;
+        const std::vector<float>& getDepthBuffer() const;
+
+        // renders the occluders from random views inside the occluder bounds and tests the boxes,
+        // printing ms/frame and the share of frustum-visible boxes that got culled
+        void Benchmark(const gps::BoxList& boxes, const glm::mat4& projection, int frames);
+
+    private:
+        struct ScreenTriangle {
+            // edge functions e(x, y) = a * x + b * y + c, inside when all three are >= 0
+            float edgeA[3], edgeB[3], edgeC[3];
+            // depth plane z(x, y) = a * x + b * y + c
+            float depthA, depthB, depthC;
+            int minX, minY, maxX, maxY;
+        };
+
+        static const int TILE_SIZE = 8;
+
+        int width = 0;
+        int height = 0;
+        int tilesX = 0;
+        int tilesY = 0;
+        unsigned int threadCount = 1;
+
+        glm::mat4 viewProjection;
+        std::vector<glm::vec3> occluderPositions;
+        std::vector<GLuint> occluderIndices;
+        std::vector<ScreenTriangle> triangles;
+        std::vector<float> depthBuffer;
+        // farthest depth inside every tile
+        std::vector<float> tileMaxDepth;
+
+        void SetupTriangles(size_t firstTriangle, size_t lastTriangle, std::vector<ScreenTriangle>& output) const;
+        void RasterizeBand(int bandMinY, int bandMaxY);
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
@@ -0,0 +1,81 @@
+#include "OffscreenTarget.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    void OffscreenTarget::Init(int width, int height, int samples) {
+        this->width = width;
+        this->height = height;
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        this->samples = std::max(std::min(samples, (int)maxSamples), 0);
+        if (this->samples == 1)
+            this->samples = 0;
+
+        // never sampled, renderbuffers are enough
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples, GL_SRGB8_ALPHA8, width, height);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, this->samples, GL_DEPTH_COMPONENT32F, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR: offscreen target " << width << "x" << height << " is incomplete" << std::endl;
+
+        if (this->samples > 0) {
+            glGenRenderbuffers(1, &resolveBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, resolveBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+            glGenFramebuffers(1, &resolveFramebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveBuffer);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR: offscreen resolve target " << width << "x" << height << " is incomplete" << std::endl;
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void OffscreenTarget::Delete() {
+        GLuint framebuffers[] = { framebuffer, resolveFramebuffer };
+        glDeleteFramebuffers(2, framebuffers);
+        GLuint renderbuffers[] = { colorBuffer, depthBuffer, resolveBuffer };
+        glDeleteRenderbuffers(3, renderbuffers);
+        framebuffer = colorBuffer = depthBuffer = resolveFramebuffer = resolveBuffer = 0;
+        width = height = samples = 0;
+    }
+
+    void OffscreenTarget::Resolve() const {
+        if (samples == 0)
+            return;
+        GLint previousFramebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    }
+
+    GLuint OffscreenTarget::getFramebuffer() const {
+        return framebuffer;
+    }
+
+    int OffscreenTarget::getWidth() const {
+        return width;
+    }
+
+    int OffscreenTarget::getHeight() const {
+        return height;
+    }
+
+    int OffscreenTarget::getSamples() const {
+        return samples;
+    }
+}
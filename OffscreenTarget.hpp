@@ -0,0 +1,38 @@
+#ifndef OffscreenTarget_hpp
+#define OffscreenTarget_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Framebuffer with an sRGB color and a 32F depth renderbuffer, replaces the default
+    // framebuffer when there is no window to present to (headless benchmark).
+    // Multisampled like the window, Resolve does the work a swap does with it.
+    class OffscreenTarget
+    {
+    public:
+        // samples is clamped to what the driver supports, 1 or less is no multisampling
+        void Init(int width, int height, int samples);
+        void Delete();
+        // downsamples the color into a single sample renderbuffer, as presenting a multisampled window does
+        void Resolve() const;
+
+        GLuint getFramebuffer() const;
+        int getWidth() const;
+        int getHeight() const;
+        int getSamples() const;
+
+    private:
+        GLuint framebuffer = 0;
+        GLuint colorBuffer = 0;
+        GLuint depthBuffer = 0;
+        // single sample copy of the color, only with multisampling
+        GLuint resolveFramebuffer = 0;
+        GLuint resolveBuffer = 0;
+        int width = 0;
+        int height = 0;
+        int samples = 0;
+    };
+}
+
+#endif /* OffscreenTarget_hpp */
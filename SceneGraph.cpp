@@ -0,0 +1,125 @@
+#include "SceneGraph.hpp"
+#include "CpuProfiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    bool SceneGraph::Load(const std::string& fileName, const std::map<std::string, gps::Model3D*>& models) {
+        CPU_SCOPE("SceneGraph::Load");
+        std::ifstream file(fileName.c_str());
+        if (!file.is_open()) {
+            std::cout << "ERROR: could not open scene " << fileName << std::endl;
+            return false;
+        }
+
+        nodes.clear();
+        bool valid = true;
+        std::string line;
+        for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+            std::istringstream tokens(line);
+            std::string keyword;
+            if (!(tokens >> keyword) || keyword[0] == '#')
+                continue;
+
+            SceneNode node;
+            std::string parentName, modelName;
+            if (keyword != "node" ||
+                !(tokens >> node.name >> parentName >> modelName) ||
+                !(tokens >> node.position.x >> node.position.y >> node.position.z) ||
+                !(tokens >> node.rotation.x >> node.rotation.y >> node.rotation.z) ||
+                !(tokens >> node.scale.x >> node.scale.y >> node.scale.z)) {
+                std::cout << fileName << ":" << lineNumber << ": expected node <name> <parent> <model> <position> <rotation> <scale>" << std::endl;
+                valid = false;
+                continue;
+            }
+
+            node.parent = parentName == "-" ? -1 : findNode(parentName);
+            if (parentName != "-" && node.parent < 0) {
+                std::cout << fileName << ":" << lineNumber << ": parent " << parentName << " must be defined before " << node.name << std::endl;
+                valid = false;
+                continue;
+            }
+
+            node.model = NULL;
+            if (modelName != "-") {
+                std::map<std::string, gps::Model3D*>::const_iterator model = models.find(modelName);
+                if (model == models.end()) {
+                    std::cout << fileName << ":" << lineNumber << ": unknown model " << modelName << std::endl;
+                    valid = false;
+                    continue;
+                }
+                node.model = model->second;
+            }
+
+            node.localDirty = true;
+            node.worldChanged = false;
+            nodes.push_back(node);
+        }
+
+        Update();
+        return valid;
+    }
+
+    int SceneGraph::findNode(const std::string& name) const {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].name == name)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    const gps::SceneNode& SceneGraph::getNode(int index) const {
+        return nodes[index];
+    }
+
+    const std::vector<gps::SceneNode>& SceneGraph::getNodes() const {
+        return nodes;
+    }
+
+    void SceneGraph::setPosition(int index, const glm::vec3& position) {
+        nodes[index].position = position;
+        nodes[index].localDirty = true;
+    }
+
+    void SceneGraph::setRotation(int index, const glm::vec3& rotation) {
+        nodes[index].rotation = rotation;
+        nodes[index].localDirty = true;
+    }
+
+    void SceneGraph::setScale(int index, const glm::vec3& scale) {
+        nodes[index].scale = scale;
+        nodes[index].localDirty = true;
+    }
+
+    void SceneGraph::Update() {
+        updatedCount = 0;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            SceneNode& node = nodes[i];
+            bool parentChanged = node.parent >= 0 && nodes[node.parent].worldChanged;
+            node.worldChanged = node.localDirty || parentChanged;
+            if (!node.worldChanged)
+                continue;
+
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), node.position);
+            local = glm::rotate(local, glm::radians(node.rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+            local = glm::rotate(local, glm::radians(node.rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+            local = glm::rotate(local, glm::radians(node.rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+            local = glm::scale(local, node.scale);
+
+            node.world = node.parent >= 0 ? nodes[node.parent].world * local : local;
+            node.worldNormal = glm::inverseTranspose(glm::mat3(node.world));
+            node.localDirty = false;
+            updatedCount++;
+        }
+    }
+
+    size_t SceneGraph::getUpdatedCount() const {
+        return updatedCount;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef SceneGraph_hpp
+#define SceneGraph_hpp
+
+#include "glm/glm.hpp"
+
+#include "Model3D.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct SceneNode {
+        std::string name;
+        // index of the parent node, -1 for roots. Parents always come before their children.
+        int parent;
+        // NULL for pure transform nodes
+        gps::Model3D* model;
+
+        // local transform: scale, then rotation (degrees, around X, then Y, then Z), then translation
+        glm::vec3 position;
+        glm::vec3 rotation;
+        glm::vec3 scale;
+
+        // cached, valid after Update
+        glm::mat4 world;
+        // inverse transpose of the upper 3x3 of world
+        glm::mat3 worldNormal;
+
+        // the local transform changed since the last Update
+        bool localDirty;
+        // world was recomputed by the last Update
+        bool worldChanged;
+    };
+
+    // Node hierarchy (e.g. windmill -> hub -> rotor) read from a text file. World and normal
+    // matrices are cached and only recomputed for nodes whose local transform or parent changed.
+    class SceneGraph
+    {
+    public:
+        // One node per line: node <name> <parent|-> <model|-> <position xyz> <rotation xyz> <scale xyz>
+        // Model names are looked up in models. Prints the problems and returns false on errors.
+        bool Load(const std::string& fileName, const std::map<std::string, gps::Model3D*>& models);
+
+        // -1 if there is no such node
+        int findNode(const std::string& name) const;
+        const gps::SceneNode& getNode(int index) const;
+        const std::vector<gps::SceneNode>& getNodes() const;
+
+        void setPosition(int index, const glm::vec3& position);
+        void setRotation(int index, const glm::vec3& rotation);
+        void setScale(int index, const glm::vec3& scale);
+
+        // recomputes the dirty world matrices, parents first
+        void Update();
+        // nodes recomputed by the last Update
+        size_t getUpdatedCount() const;
+
+    private:
+        std::vector<gps::SceneNode> nodes;
+        size_t updatedCount = 0;
+    };
+}
+
+#endif /* SceneGraph_hpp */
@@ -1,6 +1,131 @@
 #include "Shader.hpp"
+#include "CpuProfiler.hpp"
+
+#include <chrono>
+#include <cstdio>
 
 namespace gps {
+
+    namespace {
+        const unsigned int PROGRAM_MAGIC = 0x50535047; // "GPSP"
+
+        bool binaryCacheEnabled = true;
+        unsigned int compiledCount = 0;
+        unsigned int cachedCount = 0;
+        double loadMilliseconds = 0.0;
+
+        // FNV-1a, continued from hash
+        unsigned long long HashString(const std::string& value, unsigned long long hash) {
+            for (size_t i = 0; i < value.size(); i++)
+                hash = (hash ^ (unsigned char)value[i]) * 1099511628211ull;
+            return hash;
+        }
+
+        std::string getDriverString() {
+            std::string driver;
+            GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+            for (int i = 0; i < 3; i++) {
+                const GLubyte* name = glGetString(names[i]);
+                driver += name != NULL ? (const char*)name : "";
+                driver += "\n";
+            }
+            return driver;
+        }
+
+        // lets the driver compile on as many threads as it likes, once per context
+        bool enableParallelCompile() {
+            static bool checked = false;
+            static bool supported = false;
+            if (!checked) {
+                checked = true;
+                if (GLEW_KHR_parallel_shader_compile) {
+                    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                    supported = true;
+                }
+                else if (GLEW_ARB_parallel_shader_compile) {
+                    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                    supported = true;
+                }
+            }
+            return supported;
+        }
+
+        bool supportsProgramBinaries() {
+            GLint formatCount = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+            return formatCount > 0;
+        }
+    }
+
+    void Shader::setBinaryCacheEnabled(bool enabled)
+    {
+        binaryCacheEnabled = enabled;
+    }
+
+    unsigned int Shader::getCompiledCount()
+    {
+        return compiledCount;
+    }
+
+    unsigned int Shader::getCachedCount()
+    {
+        return cachedCount;
+    }
+
+    double Shader::getLoadMilliseconds()
+    {
+        return loadMilliseconds;
+    }
+
+    bool Shader::loadProgramBinary(const std::string& cachePath, unsigned long long key, GLuint program)
+    {
+        std::ifstream file(cachePath.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+
+        unsigned int magic = 0;
+        unsigned long long fileKey = 0;
+        GLenum format = 0;
+        GLint length = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        file.read(reinterpret_cast<char*>(&length), sizeof(length));
+        if (!file || magic != PROGRAM_MAGIC || fileKey != key || length <= 0)
+            return false;
+
+        std::vector<char> binary(length);
+        file.read(&binary[0], length);
+        if (!file)
+            return false;
+
+        //the driver may still refuse it, e.g. after an update that kept the version string
+        glProgramBinary(program, format, &binary[0], length);
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    void Shader::saveProgramBinary(const std::string& cachePath, unsigned long long key, GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+        std::ofstream file(cachePath.c_str(), std::ios::binary);
+        if (!file)
+            return;
+        file.write(reinterpret_cast<const char*>(&PROGRAM_MAGIC), sizeof(PROGRAM_MAGIC));
+        file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(&binary[0], length);
+    }
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -44,46 +169,184 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
     }
 
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
+        CPU_SCOPE("Shader::loadShader");
+        //keep the sources around for the variants
+        this->variants = std::make_shared<Variants>();
+        this->variants->vertexFileName = vertexShaderFileName;
+        this->variants->vertexSource = readShaderFile(vertexShaderFileName);
+        this->variants->fragmentSource = readShaderFile(fragmentShaderFileName);
+
+        this->shaderProgram = getVariant(0);
+    }
+
+    GLuint Shader::getVariant(unsigned int features)
+    {
+        std::map<unsigned int, GLuint>::iterator variant = this->variants->programs.find(features);
+        if (variant != this->variants->programs.end())
+            return variant->second;
+
+        GLuint program = compileProgram(addDefines(this->variants->vertexSource, features),
+            addDefines(this->variants->fragmentSource, features));
+        this->variants->programs[features] = program;
+        return program;
+    }
+
+    void Shader::useVariant(unsigned int features)
+    {
+        this->shaderProgram = getVariant(features);
+        useShaderProgram();
+    }
+
+    void Shader::pollCompletion()
+    {
+        if (!this->variants)
+            return;
+
+        bool parallel = enableParallelCompile();
+        std::map<GLuint, PendingProgram>::iterator pending = this->variants->pending.begin();
+        while (pending != this->variants->pending.end()) {
+            GLuint program = pending->first;
+            ++pending;
+            //without the extension there is no way to ask, finishing waits like a serial compile would
+            GLint completed = GL_TRUE;
+            if (parallel)
+                glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+            if (completed == GL_TRUE)
+                finishProgram(program);
+        }
+    }
+
+    size_t Shader::getPendingCount() const
+    {
+        return this->variants ? this->variants->pending.size() : 0;
+    }
+
+    void Shader::finishProgram(GLuint program)
+    {
+        if (!this->variants)
+            return;
+        std::map<GLuint, PendingProgram>::iterator pending = this->variants->pending.find(program);
+        if (pending == this->variants->pending.end())
+            return;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        //the first query waits for the compile to finish
+        shaderCompileLog(pending->second.vertexShader);
+        shaderCompileLog(pending->second.fragmentShader);
+        shaderLinkLog(program);
+        glDeleteShader(pending->second.vertexShader);
+        glDeleteShader(pending->second.fragmentShader);
+
+        GLint success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (pending->second.saveBinary && success == GL_TRUE)
+            saveProgramBinary(pending->second.cachePath, pending->second.key, program);
+
+        this->variants->pending.erase(pending);
+        loadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<GLuint> Shader::getVariants() const
+    {
+        std::vector<GLuint> programs;
+        for (std::map<unsigned int, GLuint>::const_iterator i = this->variants->programs.begin(); i != this->variants->programs.end(); ++i)
+            programs.push_back(i->second);
+        return programs;
+    }
+
+    std::string Shader::addDefines(const std::string& source, unsigned int features)
+    {
+        if (features == 0)
+            return source;
+
+        std::string defines;
+        if (features & SHADER_FOG)
+            defines += "#define FOG\n";
+        if (features & SHADER_SPECULAR_MAP)
+            defines += "#define SPECULAR_MAP\n";
+        if (features & SHADER_ALPHA_TEST)
+            defines += "#define ALPHA_TEST\n";
+        if (features & SHADER_POINT_LIGHTS)
+            defines += "#define POINT_LIGHTS\n";
+        if (features & SHADER_SHADOWS)
+            defines += "#define SHADOWS\n";
+
+        //#version has to stay first, #line keeps the error messages pointing at the file's own lines
+        size_t versionEnd = source.find('\n', source.find("#version"));
+        if (versionEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, versionEnd + 1) + defines + "#line 2\n" + source.substr(versionEnd + 1);
+    }
+
+    GLuint Shader::compileProgram(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        //the sources already contain the variant defines
+        unsigned long long key = HashString(getDriverString(), HashString(fragmentSource, HashString(vertexSource, 14695981039346656037ull)));
+        char keyString[17];
+        snprintf(keyString, sizeof(keyString), "%016llx", key);
+        std::string cachePath = this->variants->vertexFileName + "." + keyString + ".program";
+        bool useCache = binaryCacheEnabled && supportsProgramBinaries();
+
+        if (useCache) {
+            GLuint program = glCreateProgram();
+            if (loadProgramBinary(cachePath, key, program)) {
+                cachedCount++;
+                loadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                return program;
+            }
+            glDeleteProgram(program);
+        }
+
+        enableParallelCompile();
+
+        //compile the vertex shader, the status is checked in finishProgram
+        const GLchar* vertexShaderString = vertexSource.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
         glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
 
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
+        //compile the fragment shader
+        const GLchar* fragmentShaderString = fragmentSource.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
         glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-
-        //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+
+        //attach and link the shader programs, linking does not wait for the compiles either
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        if (useCache)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+
+        PendingProgram pending;
+        pending.vertexShader = vertexShader;
+        pending.fragmentShader = fragmentShader;
+        pending.cachePath = cachePath;
+        pending.key = key;
+        pending.saveBinary = useCache;
+        this->variants->pending[program] = pending;
+
+        compiledCount++;
+        loadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return program;
     }
 
     void Shader::useShaderProgram()
     {
+        finishProgram(this->shaderProgram);
         glUseProgram(this->shaderProgram);
     }
 
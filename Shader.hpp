@@ -8,20 +8,84 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace gps {
 
+// Optional parts of a shader, compiled in with a #define of the same name (without SHADER_)
+enum SHADER_FEATURE {
+    SHADER_FOG = 1 << 0,
+    SHADER_SPECULAR_MAP = 1 << 1,
+    SHADER_ALPHA_TEST = 1 << 2,
+    // clustered point lights, see ClusteredLights
+    SHADER_POINT_LIGHTS = 1 << 3,
+    // cascaded shadow maps of the sun, see ShadowCascades
+    SHADER_SHADOWS = 1 << 4
+};
+
 class Shader
 {
 public:
+    // program of the variant selected last, the one without features after loadShader
     GLuint shaderProgram;
+    // Compiles and links are only issued here, with GL_KHR_parallel_shader_compile the driver runs
+    // them on its own threads. The logs are checked when the program is first bound or once
+    // pollCompletion sees it finished, GL itself waits if a pending program is queried before.
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
     void useShaderProgram();
 
+    // Program with the given SHADER_* features, compile issued the first time it is asked for.
+    // Copies of a shader share the compiled variants.
+    GLuint getVariant(unsigned int features);
+    // makes the variant the shaderProgram of this object and binds it
+    void useVariant(unsigned int features);
+    // finishes the programs whose compile is done, without waiting for the others
+    void pollCompletion();
+    // programs issued but not finished yet
+    size_t getPendingCount() const;
+    // every variant compiled so far, e.g. to set the uniforms they all share
+    std::vector<GLuint> getVariants() const;
+
+    // Linked programs are saved with glGetProgramBinary next to the vertex shader file, keyed by
+    // the sources (with the variant defines) and the driver, and loaded instead of compiled next time
+    static void setBinaryCacheEnabled(bool enabled);
+    // programs compiled and programs loaded from the binary cache so far, and the time they took
+    static unsigned int getCompiledCount();
+    static unsigned int getCachedCount();
+    // time this thread spent issuing and finishing them, the driver's own compile threads not included
+    static double getLoadMilliseconds();
+
 private:
+    // a program linked from source whose logs and binary are not handled yet
+    struct PendingProgram {
+        GLuint vertexShader;
+        GLuint fragmentShader;
+        std::string cachePath;
+        unsigned long long key;
+        bool saveBinary;
+    };
+    struct Variants {
+        std::string vertexFileName;
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::map<unsigned int, GLuint> programs;
+        std::map<GLuint, PendingProgram> pending;
+    };
+    std::shared_ptr<Variants> variants;
+
     std::string readShaderFile(std::string fileName);
+    GLuint compileProgram(const std::string& vertexSource, const std::string& fragmentSource);
+    // waits for a pending program, checks its logs and saves its binary
+    void finishProgram(GLuint program);
+    // the #defines of the features, right after the #version line
+    std::string addDefines(const std::string& source, unsigned int features);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
+    // false if the cache file is missing or the driver rejects the binary
+    bool loadProgramBinary(const std::string& cachePath, unsigned long long key, GLuint program);
+    void saveProgramBinary(const std::string& cachePath, unsigned long long key, GLuint program);
 };
 
 }
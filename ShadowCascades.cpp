@@ -0,0 +1,206 @@
+#include "ShadowCascades.hpp"
+
+#include "Frustum.hpp"
+#include "CpuProfiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace gps {
+
+    const float ShadowCascades::CASTER_DISTANCE = 500.0f;
+    const float ShadowCascades::STATIC_MARGIN = 1.5f;
+
+    void ShadowCascades::Init(int resolution) {
+        this->resolution = resolution;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // hardware 2x2 filtering of the depth comparison
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        // outside the map nothing is in shadow
+        float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR: shadow map framebuffer is incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        lightDir = glm::vec3(0.0f);
+        for (int i = 0; i < CASCADE_COUNT; i++)
+            cascades[i].valid = false;
+    }
+
+    void ShadowCascades::Delete() {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &texture);
+        framebuffer = 0;
+        texture = 0;
+    }
+
+    void ShadowCascades::setProjection(float fovY, float aspect, float nearPlane, float shadowDistance) {
+        if (fovY == this->fovY && aspect == this->aspect && nearPlane == this->nearPlane && shadowDistance == this->shadowDistance)
+            return;
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->shadowDistance = shadowDistance;
+
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+        float corner2 = tanX * tanX + tanY * tanY;
+
+        float previous = nearPlane;
+        for (int i = 0; i < CASCADE_COUNT; i++) {
+            // blend of logarithmic and uniform splits
+            float t = (float)(i + 1) / CASCADE_COUNT;
+            float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, t);
+            float uniformSplit = nearPlane + (shadowDistance - nearPlane) * t;
+            splits[i] = 0.75f * logSplit + 0.25f * uniformSplit;
+
+            // smallest sphere on the view axis around the corners of both ends of the slice.
+            // It does not change when the camera turns, which keeps the cascade size constant.
+            float sliceNear = previous;
+            float sliceFar = splits[i];
+            float depth = std::min((sliceNear + sliceFar) * (1.0f + corner2) * 0.5f, sliceFar);
+            float radius = std::sqrt(sliceFar * sliceFar * corner2 + (sliceFar - depth) * (sliceFar - depth));
+            cascades[i].sphereDepth = depth;
+            cascades[i].radius = std::ceil(radius * 16.0f) / 16.0f;
+            cascades[i].valid = false;
+            previous = sliceFar;
+        }
+    }
+
+    void ShadowCascades::invalidateStatic() {
+        for (int i = FIRST_STATIC_CASCADE; i < CASCADE_COUNT; i++)
+            cascades[i].valid = false;
+    }
+
+    void ShadowCascades::Fit(Cascade& cascade, const glm::vec3& center, float halfSize) {
+        // one texel of margin for the snapping, the texel size only depends on halfSize
+        float texel = 2.0f * halfSize / (resolution - 2);
+        cascade.halfSize = texel * resolution * 0.5f;
+        cascade.center = glm::vec3(std::floor(center.x / texel) * texel, std::floor(center.y / texel) * texel, center.z);
+
+        // the light looks down -z, the box reaches CASTER_DISTANCE further towards it
+        float h = cascade.halfSize;
+        cascade.lightProjection = glm::ortho(cascade.center.x - h, cascade.center.x + h, cascade.center.y - h, cascade.center.y + h,
+            -(cascade.center.z + h) - CASTER_DISTANCE, -(cascade.center.z - h));
+        cascade.viewProjection = cascade.lightProjection * lightRotation;
+    }
+
+    bool ShadowCascades::Covers(const Cascade& cascade, const glm::vec3& center, float radius) const {
+        glm::vec3 offset = glm::abs(center - cascade.center);
+        return std::max(offset.x, std::max(offset.y, offset.z)) + radius <= cascade.halfSize;
+    }
+
+    void ShadowCascades::Render(const glm::mat4& view, const glm::vec3& lightDir, gps::Shader depthShader,
+        const std::vector<gps::SceneInstance>& instances, const std::vector<gps::SceneInstance>& staticInstances, gps::JobSystem& jobs)
+    {
+        CPU_SCOPE("ShadowCascades::Render");
+        if (lightDir != this->lightDir) {
+            this->lightDir = lightDir;
+            glm::vec3 up = std::fabs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            lightRotation = glm::lookAt(glm::vec3(0.0f), -lightDir, up);
+            invalidateStatic();
+        }
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        // the scene may be drawn into an offscreen target
+        GLint previousFramebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, resolution, resolution);
+        // against shadow acne on surfaces at a grazing angle to the light
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        depthShader.useShaderProgram();
+        GLint viewLoc = glGetUniformLocation(depthShader.shaderProgram, "view");
+        GLint projectionLoc = glGetUniformLocation(depthShader.shaderProgram, "projection");
+        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(lightRotation));
+
+        glm::mat4 inverseView = glm::inverse(view);
+        renderedCount = 0;
+        casterCount = 0;
+        for (int i = 0; i < CASCADE_COUNT; i++) {
+            Cascade& cascade = cascades[i];
+            glm::vec3 center = glm::vec3(lightRotation * inverseView * glm::vec4(0.0f, 0.0f, -cascade.sphereDepth, 1.0f));
+
+            bool isStatic = i >= FIRST_STATIC_CASCADE;
+            if (isStatic) {
+                if (cascade.valid && Covers(cascade, center, cascade.radius))
+                    continue;
+                Fit(cascade, center, cascade.radius * STATIC_MARGIN);
+            }
+            else {
+                Fit(cascade, center, cascade.radius);
+            }
+            cascade.valid = true;
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(cascade.lightProjection));
+
+            gps::Frustum frustum;
+            frustum.extract(cascade.viewProjection);
+            gps::CullStats stats;
+            cascade.casters.Build(isStatic ? staticInstances : instances, frustum, stats, jobs);
+            cascade.casters.SubmitDepth(depthShader);
+            renderedCount++;
+            casterCount += stats.visible;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    void ShadowCascades::BindTexture() const {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void ShadowCascades::setUniforms(GLuint program, const glm::mat4& view) const {
+        // from eye space to [0, 1] texture coordinates and depth of every cascade
+        glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+        glm::mat4 inverseView = glm::inverse(view);
+        glm::mat4 matrices[CASCADE_COUNT];
+        glm::vec4 texelSizes;
+        for (int i = 0; i < CASCADE_COUNT; i++) {
+            matrices[i] = bias * cascades[i].viewProjection * inverseView;
+            texelSizes[i] = 2.0f * cascades[i].halfSize / resolution;
+        }
+
+        glUniform1i(glGetUniformLocation(program, "shadowMap"), SHADOW_TEXTURE_UNIT);
+        glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrices"), CASCADE_COUNT, GL_FALSE, glm::value_ptr(matrices[0]));
+        glUniform4fv(glGetUniformLocation(program, "cascadeSplits"), 1, splits);
+        glUniform4fv(glGetUniformLocation(program, "shadowTexelSize"), 1, glm::value_ptr(texelSizes));
+    }
+
+    int ShadowCascades::getRenderedCount() const {
+        return renderedCount;
+    }
+
+    size_t ShadowCascades::getCasterCount() const {
+        return casterCount;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef ShadowCascades_hpp
+#define ShadowCascades_hpp
+
+#include <GL/glew.h>
+
+#include "glm/glm.hpp"
+
+#include "DrawList.hpp"
+#include "JobSystem.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Cascaded shadow maps of the directional light, one layer of a depth texture array per cascade.
+    // Every cascade is an orthographic box around a bounding sphere of its slice of the view frustum,
+    // snapped to whole shadow map texels so the shadows do not shimmer when the camera moves.
+    // The far cascades only hold static casters, they are drawn over a larger area and kept until
+    // the camera leaves that area, the light turns or invalidateStatic is called.
+    class ShadowCascades
+    {
+    public:
+        static const int CASCADE_COUNT = 4;
+        // this and the following cascades are cached
+        static const int FIRST_STATIC_CASCADE = 2;
+
+        void Init(int resolution = 2048);
+        void Delete();
+
+        // splits the view between nearPlane and shadowDistance, more densely near the camera.
+        // Does nothing if the projection did not change, the cached cascades stay.
+        void setProjection(float fovY, float aspect, float nearPlane, float shadowDistance);
+        // redraws the static cascades next time, e.g. after static geometry moved
+        void invalidateStatic();
+
+        // Fits the cascades around the view and draws the ones that need it with the depth shader,
+        // the static cascades with staticInstances only. Casters are culled against every cascade.
+        // lightDir points towards the light. Restores the bound framebuffer and the viewport.
+        void Render(const glm::mat4& view, const glm::vec3& lightDir, gps::Shader depthShader,
+            const std::vector<gps::SceneInstance>& instances, const std::vector<gps::SceneInstance>& staticInstances, gps::JobSystem& jobs);
+
+        // binds the shadow map to SHADOW_TEXTURE_UNIT
+        void BindTexture() const;
+        // sets the sampler, cascade matrices and splits of a SHADOWS program (in use) for the camera view
+        void setUniforms(GLuint program, const glm::mat4& view) const;
+
+        // cascades drawn by the last Render call, and the casters they drew
+        int getRenderedCount() const;
+        size_t getCasterCount() const;
+
+    private:
+        // after the G-buffer textures of the deferred path
+        static const int SHADOW_TEXTURE_UNIT = 7;
+        // casters this far behind a cascade (towards the light) still shadow it
+        static const float CASTER_DISTANCE;
+        // static cascades cover this much more than their slice needs, so they survive camera moves
+        static const float STATIC_MARGIN;
+
+        struct Cascade {
+            // bounding sphere of the frustum slice, in view space on the view axis
+            float sphereDepth;
+            float radius;
+            // light space center of the box, snapped to texels, and its half size
+            glm::vec3 center;
+            float halfSize;
+            glm::mat4 lightProjection;
+            glm::mat4 viewProjection;
+            bool valid;
+            gps::DrawList casters;
+        };
+
+        float fovY = 0.0f;
+        float aspect = 0.0f;
+        float nearPlane = 0.0f;
+        float shadowDistance = 0.0f;
+        int resolution = 0;
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        Cascade cascades[CASCADE_COUNT];
+        float splits[CASCADE_COUNT];
+        glm::vec3 lightDir;
+        glm::mat4 lightRotation;
+        int renderedCount = 0;
+        size_t casterCount = 0;
+
+        // box of the cascade around a light space sphere, snapped to its texels
+        void Fit(Cascade& cascade, const glm::vec3& center, float halfSize);
+        // true if the light space sphere is inside the box the cascade was drawn with
+        bool Covers(const Cascade& cascade, const glm::vec3& center, float radius) const;
+    };
+}
+
+#endif /* ShadowCascades_hpp */
@@ -0,0 +1,45 @@
+#include "SimulationClock.hpp"
+
+namespace gps {
+
+    void SimulationClock::Init(double now, double step, int maxSteps) {
+        this->step = step;
+        this->maxSteps = maxSteps;
+        lastTime = now;
+        accumulator = 0.0;
+        stepCount = 0;
+    }
+
+    int SimulationClock::Advance(double now) {
+        accumulator += now - lastTime;
+        lastTime = now;
+
+        // otherwise a long frame asks for more steps, which make the next frame long too
+        if (accumulator > step * maxSteps)
+            accumulator = step * maxSteps;
+
+        int steps = 0;
+        while (accumulator >= step) {
+            accumulator -= step;
+            steps++;
+        }
+        stepCount += steps;
+        return steps;
+    }
+
+    float SimulationClock::getAlpha() const {
+        return (float)(accumulator / step);
+    }
+
+    double SimulationClock::getStep() const {
+        return step;
+    }
+
+    double SimulationClock::getStepTime() const {
+        return lastTime - accumulator;
+    }
+
+    unsigned long long SimulationClock::getStepCount() const {
+        return stepCount;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SimulationClock_hpp
+#define SimulationClock_hpp
+
+namespace gps {
+
+    // Fixed timestep clock: real time is collected in an accumulator and the simulation advances in
+    // whole steps of the same length, so motion does not depend on the frame rate. What is left in
+    // the accumulator after the steps gives the blend factor between the last two simulated states.
+    class SimulationClock
+    {
+    public:
+        // now is in seconds (glfwGetTime). After a stall at most maxSteps are run and the rest is dropped.
+        void Init(double now, double step = 1.0 / 60.0, int maxSteps = 8);
+
+        // collects the real time since the last call, returns how many steps to simulate now
+        int Advance(double now);
+
+        // in [0, 1), 0 renders the state of the previous step and 1 would be the latest one
+        float getAlpha() const;
+        double getStep() const;
+        // real time the last step stands for, the next one is due a step later.
+        // The blend factor at time t is (t - getStepTime()) / getStep().
+        double getStepTime() const;
+        // steps simulated since Init
+        unsigned long long getStepCount() const;
+
+    private:
+        double step = 1.0 / 60.0;
+        int maxSteps = 8;
+        double lastTime = 0.0;
+        double accumulator = 0.0;
+        unsigned long long stepCount = 0;
+    };
+}
+
+#endif /* SimulationClock_hpp */
@@ -7,6 +7,7 @@
 //
 
 #include "SkyBox.hpp"
+#include "CpuProfiler.hpp"
 
 namespace gps {
     
@@ -17,6 +18,7 @@ namespace gps {
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
     {
+        CPU_SCOPE("SkyBox::Load");
         cubemapTexture = LoadSkyBoxTextures(cubeMapFaces);
         InitSkyBox();
     }
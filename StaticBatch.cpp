@@ -0,0 +1,326 @@
+#include "StaticBatch.hpp"
+
+#include "glm/gtc/matrix_inverse.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    bool StaticBatch::isSupported() {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return (major > 4 || (major == 4 && minor >= 3)) && GLEW_ARB_multi_draw_indirect;
+    }
+
+    GLuint StaticBatch::findMaterial(const std::vector<gps::Texture>& textures) {
+        for (GLuint i = 0; i < groups.size(); i++) {
+            if (groups[i].textures.size() != textures.size())
+                continue;
+            bool same = true;
+            for (size_t t = 0; t < textures.size() && same; t++) {
+                same = groups[i].textures[t].id == textures[t].id && groups[i].textures[t].type == textures[t].type;
+            }
+            if (same)
+                return i;
+        }
+
+        MaterialGroup group;
+        group.textures = textures;
+        group.shaderFeatures = gps::getMaterialFeatures(textures);
+        group.firstCommand = 0;
+        group.commandCount = 0;
+        groups.push_back(group);
+        return (GLuint)groups.size() - 1;
+    }
+
+    void StaticBatch::Add(gps::Model3D& model, glm::mat4 modelMatrix) {
+        std::vector<gps::Mesh>& meshes = model.getMeshes();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            BatchedDraw draw;
+            draw.mesh = &meshes[i];
+            draw.modelMatrix = modelMatrix;
+            draw.materialIndex = findMaterial(meshes[i].textures);
+            draws.push_back(draw);
+        }
+    }
+
+    void StaticBatch::Upload() {
+        // commands of one material must be contiguous in the indirect buffer
+        std::stable_sort(draws.begin(), draws.end(), [](const BatchedDraw& a, const BatchedDraw& b) {
+            return a.materialIndex < b.materialIndex;
+        });
+
+        // the whole batch uses the vertex format of its first mesh
+        if (!draws.empty())
+            vertexFormat = draws[0].mesh->vertexFormat;
+
+        std::vector<unsigned char> vertices;
+        std::vector<unsigned char> positions;
+        GLsizei vertexCount = 0;
+        std::vector<GLuint> indices;
+        // indices are relative to baseVertex, so 16 bits suffice when every mesh is small enough
+        indexType = GL_UNSIGNED_SHORT;
+        for (size_t i = 0; i < draws.size(); i++) {
+            if (draws[i].mesh->vertices.size() > gps::MAX_16BIT_VERTICES)
+                indexType = GL_UNSIGNED_INT;
+        }
+        std::vector<PerDrawData> perDraw;
+        std::vector<GLuint> drawIds;
+
+        for (size_t i = 0; i < draws.size(); i++) {
+            const gps::Mesh* mesh = draws[i].mesh;
+            draws[i].firstIndex = (GLuint)indices.size();
+
+            DrawElementsIndirectCommand command;
+            command.count = mesh->lods[0].indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = (GLuint)indices.size();
+            command.baseVertex = (GLint)vertexCount;
+            // baseInstance selects the per-draw record through the instanced drawId attribute
+            command.baseInstance = (GLuint)i;
+            commands.push_back(command);
+
+            gps::VertexDecode decode = gps::PackVertices(mesh->vertices, vertexFormat, vertices);
+            gps::PackPositions(mesh->vertices, vertexFormat, positions);
+            vertexCount += (GLsizei)mesh->vertices.size();
+            indices.insert(indices.end(), mesh->indices.begin(), mesh->indices.end());
+
+            PerDrawData data;
+            data.model = draws[i].modelMatrix;
+            data.normalModel = glm::inverseTranspose(draws[i].modelMatrix);
+            data.positionScale = glm::vec4(decode.positionScale, 0.0f);
+            data.positionBias = glm::vec4(decode.positionBias, 0.0f);
+            data.materialIndex = draws[i].materialIndex;
+            data.padding[0] = data.padding[1] = data.padding[2] = 0;
+            perDraw.push_back(data);
+
+            drawIds.push_back((GLuint)i);
+            worldBoxes.push(mesh->bounds, draws[i].modelMatrix);
+
+            MaterialGroup& group = groups[draws[i].materialIndex];
+            if (group.commandCount == 0)
+                group.firstCommand = (GLuint)i;
+            group.commandCount++;
+        }
+
+        if (draws.empty())
+            return;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &drawIdVBO);
+        glGenBuffers(1, &indirectBuffer);
+        glGenBuffers(1, &perDrawBuffer);
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size(), &vertices[0], GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (indexType == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+        }
+        else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+        }
+
+        // same attribute layout as Mesh::setupMesh
+        gps::SetupVertexAttributes(vertexFormat);
+
+        // draw id, advanced once per instance starting at baseInstance
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), &drawIds[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(3, 1);
+
+        // position-only stream for the depth pre-pass, same EBO and draw ids
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size(), &positions[0], GL_STATIC_DRAW);
+        gps::SetupPositionAttribute(vertexFormat);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(3, 1);
+
+        glBindVertexArray(0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, perDrawBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, perDraw.size() * sizeof(PerDrawData), &perDraw[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        std::cout << "Static batch : " << draws.size() << " meshes, " << groups.size() << " multi draw calls" << std::endl;
+    }
+
+    void StaticBatch::Cull(const gps::Frustum& frustum, gps::CullStats& stats, const gps::OcclusionCuller* occlusion,
+        const gps::LodSettings* lod) {
+        if (draws.empty())
+            return;
+
+        frustum.cullBoxes(worldBoxes, visible);
+        for (size_t i = 0; i < visible.size(); i++) {
+            if (!visible[i])
+                stats.culled++;
+        }
+
+        if (occlusion != NULL)
+            occlusion->cullBoxes(worldBoxes, visible, stats);
+
+        bool changed = false;
+        for (size_t i = 0; i < commands.size(); i++) {
+            GLuint instanceCount = visible[i] ? 1 : 0;
+            if (commands[i].instanceCount != instanceCount) {
+                commands[i].instanceCount = instanceCount;
+                changed = true;
+            }
+            if (!visible[i])
+                continue;
+            stats.visible++;
+
+            // without levels of detail every command goes back to the full mesh
+            const gps::MeshLod& range = draws[i].mesh->lods[lod != NULL ? draws[i].mesh->SelectLod(*lod, draws[i].modelMatrix) : 0];
+            GLuint firstIndex = draws[i].firstIndex + range.indexOffset;
+            if (commands[i].firstIndex != firstIndex) {
+                commands[i].firstIndex = firstIndex;
+                commands[i].count = range.indexCount;
+                changed = true;
+            }
+        }
+
+        // only re-upload the command buffer when the visible set or a level of detail changed
+        if (changed) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0]);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    bool StaticBatch::hasAlphaTestedGroups() const {
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (groups[g].shaderFeatures & gps::SHADER_ALPHA_TEST)
+                return true;
+        }
+        return false;
+    }
+
+    void StaticBatch::PrepareShader(gps::Shader shader, unsigned int features) const {
+        for (size_t g = 0; g < groups.size(); g++)
+            shader.getVariant(features | groups[g].shaderFeatures);
+    }
+
+    void StaticBatch::Draw(gps::Shader shader, unsigned int features) {
+        if (draws.empty())
+            return;
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, perDrawBuffer);
+
+        bool alphaTested = hasAlphaTestedGroups();
+        GLboolean depthWrites = GL_TRUE;
+        if (alphaTested)
+            glGetBooleanv(GL_DEPTH_WRITEMASK, &depthWrites);
+
+        // opaque materials first, then the alpha tested ones
+        GLuint currentProgram = 0;
+        for (int pass = 0; pass < (alphaTested ? 2 : 1); pass++) {
+            if (pass == 1)
+                glDepthMask(GL_TRUE);
+
+            for (size_t g = 0; g < groups.size(); g++) {
+                const MaterialGroup& group = groups[g];
+                bool groupAlphaTested = (group.shaderFeatures & gps::SHADER_ALPHA_TEST) != 0;
+                if (group.commandCount == 0 || groupAlphaTested != (pass == 1))
+                    continue;
+
+                shader.useVariant(features | group.shaderFeatures);
+                if (shader.shaderProgram != currentProgram) {
+                    glUniform1i(glGetUniformLocation(shader.shaderProgram, "octahedralNormals"), vertexFormat == gps::VERTEX_FORMAT_OCT16);
+                    currentProgram = shader.shaderProgram;
+                }
+
+                //set textures
+                for (GLuint i = 0; i < group.textures.size(); i++) {
+                    glActiveTexture(GL_TEXTURE0 + i);
+                    glUniform1i(glGetUniformLocation(shader.shaderProgram, group.textures[i].type.c_str()), i);
+                    glBindTexture(GL_TEXTURE_2D, group.textures[i].id);
+                }
+
+                glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                    (GLvoid*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)), group.commandCount, 0);
+
+                for (GLuint i = 0; i < group.textures.size(); i++) {
+                    glActiveTexture(GL_TEXTURE0 + i);
+                    glBindTexture(GL_TEXTURE_2D, 0);
+                }
+            }
+        }
+
+        if (alphaTested)
+            glDepthMask(depthWrites);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void StaticBatch::DrawDepth(gps::Shader shader) {
+        if (draws.empty())
+            return;
+
+        shader.useShaderProgram();
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, perDrawBuffer);
+        if (!hasAlphaTestedGroups()) {
+            // no textures, so every command goes in a single call
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (GLvoid*)0, (GLsizei)commands.size(), 0);
+        }
+        else {
+            // the position-only stream can not alpha test, those materials only get drawn by Draw
+            for (size_t g = 0; g < groups.size(); g++) {
+                const MaterialGroup& group = groups[g];
+                if (group.commandCount == 0 || (group.shaderFeatures & gps::SHADER_ALPHA_TEST))
+                    continue;
+                glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                    (GLvoid*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)), group.commandCount, 0);
+            }
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void StaticBatch::Delete() {
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &drawIdVBO);
+        glDeleteBuffers(1, &indirectBuffer);
+        glDeleteBuffers(1, &perDrawBuffer);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteVertexArrays(1, &depthVAO);
+        draws.clear();
+        groups.clear();
+        commands.clear();
+        worldBoxes.clear();
+    }
+
+    GLsizei StaticBatch::getDrawCount() {
+        return (GLsizei)draws.size();
+    }
+
+    GLsizei StaticBatch::getMultiDrawCount() {
+        return (GLsizei)groups.size();
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef StaticBatch_hpp
+#define StaticBatch_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+#include "Model3D.hpp"
+#include "Shader.hpp"
+#include "Frustum.hpp"
+#include "OcclusionCuller.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Layout of one glMultiDrawElementsIndirect command
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Per-draw data read by basicIndirect.vert (std430 layout)
+    struct PerDrawData {
+        glm::mat4 model;
+        glm::mat4 normalModel;
+        // decoding of packed positions, see VertexDecode
+        glm::vec4 positionScale;
+        glm::vec4 positionBias;
+        GLuint materialIndex;
+        GLuint padding[3];
+    };
+
+    // Packs the meshes of static models into one VBO/EBO pair and draws them
+    // with one glMultiDrawElementsIndirect call per material (needs GL 4.3)
+    class StaticBatch
+    {
+    public:
+        // true if the current context can draw indirect batches
+        static bool isSupported();
+
+        // queues every mesh of the model, placed with the given model matrix
+        void Add(gps::Model3D& model, glm::mat4 modelMatrix);
+        // uploads the packed buffers, call once after all Add() calls
+        void Upload();
+        // zeroes the instance count of the commands whose mesh is outside the frustum or occluded,
+        // and points the visible ones at the level of detail picked from the lod settings
+        void Cull(const gps::Frustum& frustum, gps::CullStats& stats, const gps::OcclusionCuller* occlusion = NULL,
+            const gps::LodSettings* lod = NULL);
+        // every material is drawn with the shader variant for features plus its own (SHADER_*).
+        // Alpha tested materials come last, with depth writes on, since the pre-pass skips them.
+        void Draw(gps::Shader shader, unsigned int features = 0);
+        // compiles the variants Draw is going to use
+        void PrepareShader(gps::Shader shader, unsigned int features) const;
+        // positions only, all materials in one call, for the depth pre-pass
+        void DrawDepth(gps::Shader shader);
+        void Delete();
+
+        GLsizei getDrawCount();
+        GLsizei getMultiDrawCount();
+
+    private:
+        struct BatchedDraw {
+            gps::Mesh* mesh;
+            glm::mat4 modelMatrix;
+            GLuint materialIndex;
+            // first index of the mesh in the packed EBO
+            GLuint firstIndex;
+        };
+
+        // draws sharing the same textures, drawn by one multi draw call
+        struct MaterialGroup {
+            std::vector<gps::Texture> textures;
+            unsigned int shaderFeatures;
+            GLuint firstCommand;
+            GLsizei commandCount;
+        };
+
+        std::vector<BatchedDraw> draws;
+        std::vector<MaterialGroup> groups;
+        gps::VERTEX_FORMAT vertexFormat = gps::VERTEX_FORMAT_FULL;
+        GLenum indexType = GL_UNSIGNED_INT;
+        std::vector<DrawElementsIndirectCommand> commands;
+        // world space boxes of the draws, in command order
+        gps::BoxList worldBoxes;
+        std::vector<unsigned char> visible;
+
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint EBO = 0;
+        GLuint drawIdVBO = 0;
+        GLuint indirectBuffer = 0;
+        GLuint perDrawBuffer = 0;
+        GLuint depthVAO = 0;
+        GLuint positionVBO = 0;
+
+        GLuint findMaterial(const std::vector<gps::Texture>& textures);
+        bool hasAlphaTestedGroups() const;
+    };
+}
+
+#endif /* StaticBatch_hpp */
@@ -0,0 +1,305 @@
+#include "TransformSystem.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace gps {
+
+    namespace {
+
+#if defined(TRANSFORM_AVX2)
+        typedef __m256 Lanes;
+        const size_t LANE_COUNT = 8;
+
+        inline Lanes LoadLanes(const float* values) { return _mm256_loadu_ps(values); }
+        inline Lanes SetLanes(float value) { return _mm256_set1_ps(value); }
+        inline Lanes AddLanes(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+        inline Lanes SubLanes(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+        inline Lanes MulLanes(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+        inline Lanes DivLanes(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+        // objects 4 * half .. 4 * half + 3
+        inline __m128 Half(Lanes a, size_t half) { return half == 0 ? _mm256_castps256_ps128(a) : _mm256_extractf128_ps(a, 1); }
+#elif defined(TRANSFORM_SSE)
+        typedef __m128 Lanes;
+        const size_t LANE_COUNT = 4;
+
+        inline Lanes LoadLanes(const float* values) { return _mm_loadu_ps(values); }
+        inline Lanes SetLanes(float value) { return _mm_set1_ps(value); }
+        inline Lanes AddLanes(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+        inline Lanes SubLanes(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+        inline Lanes MulLanes(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+        inline Lanes DivLanes(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+        inline __m128 Half(Lanes a, size_t) { return a; }
+#endif
+
+#if defined(TRANSFORM_AVX2) || defined(TRANSFORM_SSE)
+        // upper 3x3 of a matrix, every element broadcast to all lanes
+        struct LaneMatrix {
+            Lanes m[3][3];
+
+            explicit LaneMatrix(const glm::mat4& matrix) {
+                for (int c = 0; c < 3; c++)
+                    for (int r = 0; r < 3; r++)
+                        m[c][r] = SetLanes(matrix[c][r]);
+            }
+
+            void Transform(Lanes x, Lanes y, Lanes z, Lanes& outX, Lanes& outY, Lanes& outZ) const {
+                outX = AddLanes(AddLanes(MulLanes(m[0][0], x), MulLanes(m[1][0], y)), MulLanes(m[2][0], z));
+                outY = AddLanes(AddLanes(MulLanes(m[0][1], x), MulLanes(m[1][1], y)), MulLanes(m[2][1], z));
+                outZ = AddLanes(AddLanes(MulLanes(m[0][2], x), MulLanes(m[1][2], y)), MulLanes(m[2][2], z));
+            }
+        };
+
+        // writes column 'column' of the matrices of objects first .. first + LANE_COUNT - 1
+        void StoreColumn(Lanes x, Lanes y, Lanes z, Lanes w, glm::mat4* matrices, int column) {
+            for (size_t half = 0; half < LANE_COUNT / 4; half++) {
+                __m128 c0 = Half(x, half), c1 = Half(y, half), c2 = Half(z, half), c3 = Half(w, half);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                glm::mat4* out = matrices + 4 * half;
+                _mm_storeu_ps(&out[0][column][0], c0);
+                _mm_storeu_ps(&out[1][column][0], c1);
+                _mm_storeu_ps(&out[2][column][0], c2);
+                _mm_storeu_ps(&out[3][column][0], c3);
+            }
+        }
+
+        // same for 3x3 matrices. Columns 0 and 1 spill one float into the next column, so they
+        // have to be stored in order; column 2 is written exactly.
+        void StoreColumn(Lanes x, Lanes y, Lanes z, glm::mat3* matrices, int column) {
+            for (size_t half = 0; half < LANE_COUNT / 4; half++) {
+                __m128 c0 = Half(x, half), c1 = Half(y, half), c2 = Half(z, half), c3 = _mm_setzero_ps();
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                __m128 columns[4] = { c0, c1, c2, c3 };
+                for (int k = 0; k < 4; k++) {
+                    float* out = &matrices[4 * half + k][column][0];
+                    if (column < 2) {
+                        _mm_storeu_ps(out, columns[k]);
+                    }
+                    else {
+                        _mm_storel_pi((__m64*)out, columns[k]);
+                        _mm_store_ss(out + 2, _mm_movehl_ps(columns[k], columns[k]));
+                    }
+                }
+            }
+        }
+#endif
+
+        double ElapsedMs(std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    size_t TransformSystem::Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+        positionX.push_back(position.x);
+        positionY.push_back(position.y);
+        positionZ.push_back(position.z);
+        rotationX.push_back(rotation.x);
+        rotationY.push_back(rotation.y);
+        rotationZ.push_back(rotation.z);
+        rotationW.push_back(rotation.w);
+        scaleX.push_back(scale.x);
+        scaleY.push_back(scale.y);
+        scaleZ.push_back(scale.z);
+        return positionX.size() - 1;
+    }
+
+    void TransformSystem::Clear() {
+        positionX.clear(); positionY.clear(); positionZ.clear();
+        rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+        scaleX.clear(); scaleY.clear(); scaleZ.clear();
+        world.clear();
+        worldView.clear();
+        normal.clear();
+    }
+
+    size_t TransformSystem::size() const {
+        return positionX.size();
+    }
+
+    void TransformSystem::setPosition(size_t index, const glm::vec3& position) {
+        positionX[index] = position.x;
+        positionY[index] = position.y;
+        positionZ[index] = position.z;
+    }
+
+    void TransformSystem::setRotation(size_t index, const glm::quat& rotation) {
+        rotationX[index] = rotation.x;
+        rotationY[index] = rotation.y;
+        rotationZ[index] = rotation.z;
+        rotationW[index] = rotation.w;
+    }
+
+    void TransformSystem::setScale(size_t index, const glm::vec3& scale) {
+        scaleX[index] = scale.x;
+        scaleY[index] = scale.y;
+        scaleZ[index] = scale.z;
+    }
+
+    void TransformSystem::Update(const glm::mat4& view) {
+        size_t count = size();
+        world.resize(count);
+        worldView.resize(count);
+        normal.resize(count);
+        size_t i = 0;
+
+#if defined(TRANSFORM_AVX2) || defined(TRANSFORM_SSE)
+        LaneMatrix viewRotation(view);
+        Lanes viewX = SetLanes(view[3][0]), viewY = SetLanes(view[3][1]), viewZ = SetLanes(view[3][2]);
+        Lanes zero = SetLanes(0.0f), one = SetLanes(1.0f), two = SetLanes(2.0f);
+
+        for (; i + LANE_COUNT <= count; i += LANE_COUNT) {
+            Lanes px = LoadLanes(&positionX[i]), py = LoadLanes(&positionY[i]), pz = LoadLanes(&positionZ[i]);
+            Lanes qx = LoadLanes(&rotationX[i]), qy = LoadLanes(&rotationY[i]), qz = LoadLanes(&rotationZ[i]), qw = LoadLanes(&rotationW[i]);
+            Lanes sx = LoadLanes(&scaleX[i]), sy = LoadLanes(&scaleY[i]), sz = LoadLanes(&scaleZ[i]);
+
+            // rotation matrix of the quaternion, r[column][row]
+            Lanes xx = MulLanes(qx, qx), yy = MulLanes(qy, qy), zz = MulLanes(qz, qz);
+            Lanes xy = MulLanes(qx, qy), xz = MulLanes(qx, qz), yz = MulLanes(qy, qz);
+            Lanes wx = MulLanes(qw, qx), wy = MulLanes(qw, qy), wz = MulLanes(qw, qz);
+            Lanes r[3][3];
+            r[0][0] = SubLanes(one, MulLanes(two, AddLanes(yy, zz)));
+            r[0][1] = MulLanes(two, AddLanes(xy, wz));
+            r[0][2] = MulLanes(two, SubLanes(xz, wy));
+            r[1][0] = MulLanes(two, SubLanes(xy, wz));
+            r[1][1] = SubLanes(one, MulLanes(two, AddLanes(xx, zz)));
+            r[1][2] = MulLanes(two, AddLanes(yz, wx));
+            r[2][0] = MulLanes(two, AddLanes(xz, wy));
+            r[2][1] = MulLanes(two, SubLanes(yz, wx));
+            r[2][2] = SubLanes(one, MulLanes(two, AddLanes(xx, yy)));
+
+            Lanes scale[3] = { sx, sy, sz };
+            for (int c = 0; c < 3; c++) {
+                // world = T * R * S
+                Lanes cx = MulLanes(r[c][0], scale[c]), cy = MulLanes(r[c][1], scale[c]), cz = MulLanes(r[c][2], scale[c]);
+                StoreColumn(cx, cy, cz, zero, &world[i], c);
+
+                Lanes vx, vy, vz;
+                viewRotation.Transform(cx, cy, cz, vx, vy, vz);
+                StoreColumn(vx, vy, vz, zero, &worldView[i], c);
+
+                // inverse transpose of R * S is R * S^-1
+                Lanes nx, ny, nz;
+                viewRotation.Transform(DivLanes(r[c][0], scale[c]), DivLanes(r[c][1], scale[c]), DivLanes(r[c][2], scale[c]), nx, ny, nz);
+                StoreColumn(nx, ny, nz, &normal[i], c);
+            }
+
+            StoreColumn(px, py, pz, one, &world[i], 3);
+            Lanes tx, ty, tz;
+            viewRotation.Transform(px, py, pz, tx, ty, tz);
+            StoreColumn(AddLanes(tx, viewX), AddLanes(ty, viewY), AddLanes(tz, viewZ), one, &worldView[i], 3);
+        }
+#endif
+
+        // remaining objects (or everything without SIMD)
+        for (; i < count; i++)
+            UpdateScalar(i, view);
+    }
+
+    void TransformSystem::UpdateScalar(size_t index, const glm::mat4& view) {
+        glm::mat3 rotation = glm::mat3_cast(glm::quat(rotationW[index], rotationX[index], rotationY[index], rotationZ[index]));
+        glm::vec3 scale(scaleX[index], scaleY[index], scaleZ[index]);
+        glm::mat3 viewRotation = glm::mat3(view);
+
+        glm::mat4& objectWorld = world[index];
+        glm::mat3 objectNormal;
+        for (int c = 0; c < 3; c++) {
+            objectWorld[c] = glm::vec4(rotation[c] * scale[c], 0.0f);
+            objectNormal[c] = rotation[c] / scale[c];
+        }
+        objectWorld[3] = glm::vec4(positionX[index], positionY[index], positionZ[index], 1.0f);
+
+        worldView[index] = view * objectWorld;
+        normal[index] = viewRotation * objectNormal;
+    }
+
+    const std::vector<glm::mat4>& TransformSystem::getWorld() const {
+        return world;
+    }
+
+    const std::vector<glm::mat4>& TransformSystem::getWorldView() const {
+        return worldView;
+    }
+
+    const std::vector<glm::mat3>& TransformSystem::getNormal() const {
+        return normal;
+    }
+
+    void TransformSystem::Benchmark(size_t count, int frames) {
+        // objects spinning around random axes, scattered over the scene
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::vec3> positions(count), axes(count), scales(count);
+        std::vector<float> speeds(count);
+        for (size_t i = 0; i < count; i++) {
+            positions[i] = glm::vec3(unit(random), unit(random) * 0.25f, unit(random)) * 400.0f - glm::vec3(200.0f, 0.0f, 200.0f);
+            axes[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - glm::vec3(0.5f) + glm::vec3(0.0f, 1e-3f, 0.0f));
+            scales[i] = glm::vec3(0.5f) + glm::vec3(unit(random), unit(random), unit(random));
+            speeds[i] = unit(random) * 4.0f;
+        }
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 50.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        // glm, one object at a time, like the scene graph
+        std::vector<glm::mat4> glmWorld(count), glmWorldView(count);
+        std::vector<glm::mat3> glmNormal(count);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            for (size_t i = 0; i < count; i++) {
+                glm::mat4 objectWorld = glm::translate(glm::mat4(1.0f), positions[i]);
+                objectWorld = glm::rotate(objectWorld, speeds[i] * frame, axes[i]);
+                objectWorld = glm::scale(objectWorld, scales[i]);
+                glmWorld[i] = objectWorld;
+                glmWorldView[i] = view * objectWorld;
+                glmNormal[i] = glm::mat3(glm::inverseTranspose(view * objectWorld));
+            }
+        }
+        double glmMs = ElapsedMs(start) / frames;
+
+        TransformSystem transforms;
+        for (size_t i = 0; i < count; i++)
+            transforms.Add(positions[i], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), scales[i]);
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            for (size_t i = 0; i < count; i++)
+                transforms.setRotation(i, glm::angleAxis(speeds[i] * frame, axes[i]));
+            transforms.Update(view);
+        }
+        double batchMs = ElapsedMs(start) / frames;
+
+        // both paths end on the same frame
+        float maxError = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    maxError = std::max(maxError, std::fabs(glmWorldView[i][c][r] - transforms.worldView[i][c][r]));
+            for (int c = 0; c < 3; c++)
+                for (int r = 0; r < 3; r++)
+                    maxError = std::max(maxError, std::fabs(glmNormal[i][c][r] - transforms.normal[i][c][r]));
+        }
+
+#if defined(TRANSFORM_AVX2)
+        const char* path = "AVX2";
+#elif defined(TRANSFORM_SSE)
+        const char* path = "SSE";
+#else
+        const char* path = "scalar";
+#endif
+        std::cout << "Transform benchmark (" << count << " animated objects, " << frames << " frames)" << std::endl;
+        std::cout << "  glm per object : " << glmMs << " ms/frame" << std::endl;
+        std::cout << "  SoA " << path << " : " << batchMs << " ms/frame (" << glmMs / batchMs << "x)" << std::endl;
+        std::cout << "  largest difference : " << maxError << std::endl;
+    }
+}
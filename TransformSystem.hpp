@@ -0,0 +1,51 @@
+#ifndef TransformSystem_hpp
+#define TransformSystem_hpp
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Transforms of flat (parentless) dynamic objects, stored as structure of arrays so the
+    // matrices are computed 8 (AVX2) or 4 (SSE) objects at a time, with a scalar fallback.
+    // Rotations are unit quaternions, so the normal matrix is R * S^-1 and needs no inverse.
+    class TransformSystem
+    {
+    public:
+        // returns the index of the new object
+        size_t Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+        void Clear();
+        size_t size() const;
+
+        void setPosition(size_t index, const glm::vec3& position);
+        void setRotation(size_t index, const glm::quat& rotation);
+        void setScale(size_t index, const glm::vec3& scale);
+
+        // Computes the world, world-view and view space normal matrices of every object.
+        // The view has to be a rigid transform (camera look-at).
+        void Update(const glm::mat4& view);
+
+        const std::vector<glm::mat4>& getWorld() const;
+        const std::vector<glm::mat4>& getWorldView() const;
+        const std::vector<glm::mat3>& getNormal() const;
+
+        // animates count spinning objects for a number of frames, once with glm one object at a time
+        // and once with Update, printing the time per frame of both
+        static void Benchmark(size_t count, int frames);
+
+    private:
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<float> scaleX, scaleY, scaleZ;
+
+        std::vector<glm::mat4> world;
+        std::vector<glm::mat4> worldView;
+        std::vector<glm::mat3> normal;
+
+        void UpdateScalar(size_t index, const glm::mat4& view);
+    };
+}
+
+#endif /* TransformSystem_hpp */
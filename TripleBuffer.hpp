@@ -0,0 +1,47 @@
+#ifndef TripleBuffer_hpp
+#define TripleBuffer_hpp
+
+#include <atomic>
+
+namespace gps {
+
+    // Hands the newest value from one writer thread to one reader thread without locks or waiting.
+    // Each side owns one of three slots and the third one is shared: the writer fills its slot and
+    // swaps it with the shared one, the reader swaps its slot for the shared one when something new
+    // was published there. Values published while the reader was busy are skipped.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() : shared(1) {}
+
+        // the writer's slot, filled before Publish
+        T& getWriteSlot() {
+            return slots[writeIndex];
+        }
+
+        // makes the write slot the newest value and hands the writer another slot
+        void Publish() {
+            writeIndex = shared.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // the newest published value, stays untouched by the writer until the next Read
+        const T& Read() {
+            if (shared.load(std::memory_order_relaxed) & FRESH)
+                readIndex = shared.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+            return slots[readIndex];
+        }
+
+    private:
+        // the shared slot index has this bit while it holds a value the reader did not take
+        static const unsigned int FRESH = 4;
+        static const unsigned int INDEX_MASK = 3;
+
+        T slots[3];
+        unsigned int writeIndex = 0;
+        unsigned int readIndex = 2;
+        std::atomic<unsigned int> shared;
+    };
+}
+
+#endif /* TripleBuffer_hpp */
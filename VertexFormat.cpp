@@ -0,0 +1,296 @@
+#include "VertexFormat.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+        float SignNotZero(float value) {
+            return value >= 0.0f ? 1.0f : -1.0f;
+        }
+
+        GLshort ToSnorm16(float value) {
+            return (GLshort)std::floor(glm::clamp(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+        }
+
+        float FromSnorm16(GLshort value) {
+            return std::max(value / 32767.0f, -1.0f);
+        }
+
+        GLushort ToUnorm16(float value) {
+            return (GLushort)std::floor(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+
+        int ToSnorm10(float value) {
+            return (int)std::floor(glm::clamp(value, -1.0f, 1.0f) * 511.0f + 0.5f);
+        }
+
+        float FromSnorm10(int value) {
+            return std::max(value / 511.0f, -1.0f);
+        }
+
+        // sign extends the 10 bit field starting at shift
+        int ExtractSnorm10(GLuint packed, int shift) {
+            int value = (int)((packed >> shift) & 0x3ff);
+            return value >= 512 ? value - 1024 : value;
+        }
+
+        VertexDecode ComputeDecode(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format) {
+            VertexDecode decode;
+            decode.positionScale = glm::vec3(1.0f);
+            decode.positionBias = glm::vec3(0.0f);
+            if (format == VERTEX_FORMAT_FULL || vertices.empty())
+                return decode;
+
+            glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+            for (size_t i = 0; i < vertices.size(); i++) {
+                minimum = glm::min(minimum, vertices[i].Position);
+                maximum = glm::max(maximum, vertices[i].Position);
+            }
+            decode.positionScale = maximum - minimum;
+            decode.positionBias = minimum;
+            return decode;
+        }
+
+        PackedVertex PackVertex(const gps::Vertex& vertex, VERTEX_FORMAT format, const VertexDecode& decode) {
+            PackedVertex packed;
+            for (int c = 0; c < 3; c++) {
+                float extent = decode.positionScale[c];
+                packed.position[c] = ToUnorm16(extent > 0.0f ? (vertex.Position[c] - decode.positionBias[c]) / extent : 0.0f);
+            }
+            packed.position[3] = 0;
+
+            if (format == VERTEX_FORMAT_OCT16) {
+                glm::vec2 encoded = OctahedralEncode(vertex.Normal);
+                GLshort components[2] = { ToSnorm16(encoded.x), ToSnorm16(encoded.y) };
+                memcpy(&packed.normal, components, sizeof(components));
+            }
+            else {
+                glm::vec3 normal = vertex.Normal;
+                float length = glm::length(normal);
+                if (length > 0.0f)
+                    normal /= length;
+                packed.normal = (GLuint)(ToSnorm10(normal.x) & 0x3ff)
+                    | ((GLuint)(ToSnorm10(normal.y) & 0x3ff) << 10)
+                    | ((GLuint)(ToSnorm10(normal.z) & 0x3ff) << 20);
+            }
+
+            packed.texCoords[0] = FloatToHalf(vertex.TexCoords.x);
+            packed.texCoords[1] = FloatToHalf(vertex.TexCoords.y);
+            return packed;
+        }
+
+        gps::Vertex UnpackVertex(const PackedVertex& packed, VERTEX_FORMAT format, const VertexDecode& decode) {
+            gps::Vertex vertex;
+            for (int c = 0; c < 3; c++)
+                vertex.Position[c] = packed.position[c] / 65535.0f * decode.positionScale[c] + decode.positionBias[c];
+
+            if (format == VERTEX_FORMAT_OCT16) {
+                GLshort components[2];
+                memcpy(components, &packed.normal, sizeof(components));
+                vertex.Normal = OctahedralDecode(glm::vec2(FromSnorm16(components[0]), FromSnorm16(components[1])));
+            }
+            else {
+                vertex.Normal = glm::vec3(FromSnorm10(ExtractSnorm10(packed.normal, 0)),
+                    FromSnorm10(ExtractSnorm10(packed.normal, 10)), FromSnorm10(ExtractSnorm10(packed.normal, 20)));
+            }
+
+            vertex.TexCoords = glm::vec2(HalfToFloat(packed.texCoords[0]), HalfToFloat(packed.texCoords[1]));
+            return vertex;
+        }
+    }
+
+    const char* getVertexFormatName(VERTEX_FORMAT format) {
+        switch (format) {
+        case VERTEX_FORMAT_OCT16:
+            return "oct16";
+        case VERTEX_FORMAT_1010102:
+            return "1010102";
+        default:
+            return "full";
+        }
+    }
+
+    bool ParseVertexFormat(const char* name, VERTEX_FORMAT& format) {
+        const VERTEX_FORMAT formats[] = { VERTEX_FORMAT_FULL, VERTEX_FORMAT_OCT16, VERTEX_FORMAT_1010102 };
+        for (int i = 0; i < 3; i++) {
+            if (strcmp(name, getVertexFormatName(formats[i])) == 0) {
+                format = formats[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    GLsizei getVertexSize(VERTEX_FORMAT format) {
+        return format == VERTEX_FORMAT_FULL ? sizeof(gps::Vertex) : sizeof(PackedVertex);
+    }
+
+    VertexDecode PackVertices(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format, std::vector<unsigned char>& output) {
+        VertexDecode decode = ComputeDecode(vertices, format);
+        size_t offset = output.size();
+        output.resize(offset + vertices.size() * getVertexSize(format));
+        if (vertices.empty())
+            return decode;
+
+        if (format == VERTEX_FORMAT_FULL) {
+            memcpy(&output[offset], &vertices[0], vertices.size() * sizeof(gps::Vertex));
+            return decode;
+        }
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+            PackedVertex packed = PackVertex(vertices[i], format, decode);
+            memcpy(&output[offset + i * sizeof(PackedVertex)], &packed, sizeof(PackedVertex));
+        }
+        return decode;
+    }
+
+    void SetupVertexAttributes(VERTEX_FORMAT format) {
+        GLsizei stride = getVertexSize(format);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+
+        if (format == VERTEX_FORMAT_FULL) {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Normal));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, TexCoords));
+            return;
+        }
+
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, position));
+        if (format == VERTEX_FORMAT_OCT16)
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, normal));
+        else
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(PackedVertex, texCoords));
+    }
+
+    GLsizei getPositionSize(VERTEX_FORMAT format) {
+        return format == VERTEX_FORMAT_FULL ? sizeof(glm::vec3) : sizeof(PackedVertex::position);
+    }
+
+    VertexDecode PackPositions(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format, std::vector<unsigned char>& output) {
+        VertexDecode decode = ComputeDecode(vertices, format);
+        GLsizei size = getPositionSize(format);
+        size_t offset = output.size();
+        output.resize(offset + vertices.size() * size);
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+            if (format == VERTEX_FORMAT_FULL) {
+                memcpy(&output[offset + i * size], &vertices[i].Position, size);
+            }
+            else {
+                PackedVertex packed = PackVertex(vertices[i], format, decode);
+                memcpy(&output[offset + i * size], packed.position, size);
+            }
+        }
+        return decode;
+    }
+
+    void SetupPositionAttribute(VERTEX_FORMAT format) {
+        glEnableVertexAttribArray(0);
+        if (format == VERTEX_FORMAT_FULL)
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, getPositionSize(format), (GLvoid*)0);
+        else
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, getPositionSize(format), (GLvoid*)0);
+    }
+
+    VertexFormatError MeasureVertexError(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format) {
+        VertexFormatError error = { 0.0f, 0.0f, 0.0f };
+        if (format == VERTEX_FORMAT_FULL)
+            return error;
+
+        VertexDecode decode = ComputeDecode(vertices, format);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            gps::Vertex decoded = UnpackVertex(PackVertex(vertices[i], format, decode), format, decode);
+
+            error.position = std::max(error.position, glm::length(decoded.Position - vertices[i].Position));
+
+            float originalLength = glm::length(vertices[i].Normal);
+            float decodedLength = glm::length(decoded.Normal);
+            if (originalLength > 0.0f && decodedLength > 0.0f) {
+                float cosine = glm::clamp(glm::dot(vertices[i].Normal, decoded.Normal) / (originalLength * decodedLength), -1.0f, 1.0f);
+                error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+            }
+
+            glm::vec2 uvError = glm::abs(decoded.TexCoords - vertices[i].TexCoords);
+            error.texCoords = std::max(error.texCoords, std::max(uvError.x, uvError.y));
+        }
+        return error;
+    }
+
+    glm::vec2 OctahedralEncode(glm::vec3 normal) {
+        float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (sum <= 0.0f)
+            return glm::vec2(0.0f);
+        glm::vec2 p(normal.x / sum, normal.y / sum);
+        // fold the lower hemisphere over the diagonals
+        if (normal.z < 0.0f)
+            p = glm::vec2((1.0f - std::fabs(p.y)) * SignNotZero(p.x), (1.0f - std::fabs(p.x)) * SignNotZero(p.y));
+        return p;
+    }
+
+    glm::vec3 OctahedralDecode(glm::vec2 encoded) {
+        // same as octahedralDecode in basic.vert
+        glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+        float t = std::max(-normal.z, 0.0f);
+        normal.x += normal.x >= 0.0f ? -t : t;
+        normal.y += normal.y >= 0.0f ? -t : t;
+        return glm::normalize(normal);
+    }
+
+    GLushort FloatToHalf(float value) {
+        GLuint bits;
+        memcpy(&bits, &value, sizeof(bits));
+        GLuint sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        GLuint mantissa = bits & 0x7fffff;
+
+        if ((bits & 0x7fffffff) > 0x7f800000)
+            return (GLushort)(sign | 0x7e00);
+        if (exponent >= 31)
+            return (GLushort)(sign | 0x7c00);
+        if (exponent <= 0) {
+            // subnormal half, or zero
+            if (exponent < -10)
+                return (GLushort)sign;
+            mantissa |= 0x800000;
+            int shift = 14 - exponent;
+            GLuint half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1)
+                half++;
+            return (GLushort)(sign | half);
+        }
+
+        GLuint half = sign | ((GLuint)exponent << 10) | (mantissa >> 13);
+        // round to nearest, a carry correctly moves into the exponent
+        if (mantissa & 0x1000)
+            half++;
+        return (GLushort)half;
+    }
+
+    float HalfToFloat(GLushort value) {
+        GLuint sign = (GLuint)(value & 0x8000) << 16;
+        GLuint exponent = (value >> 10) & 0x1f;
+        GLuint mantissa = value & 0x3ff;
+
+        if (exponent == 0) {
+            float result = std::ldexp((float)mantissa, -24);
+            return sign ? -result : result;
+        }
+
+        GLuint bits;
+        if (exponent == 31)
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else
+            bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+}
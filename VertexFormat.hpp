@@ -0,0 +1,70 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct Vertex;
+
+    // GPU layouts of gps::Vertex. The packed ones take 16 bytes instead of 32:
+    // positions as unorm16 relative to the mesh AABB, UVs as half floats, and normals as
+    // octahedral 2 x snorm16 or as snorm 10:10:10:2
+    enum VERTEX_FORMAT {
+        VERTEX_FORMAT_FULL,
+        VERTEX_FORMAT_OCT16,
+        VERTEX_FORMAT_1010102
+    };
+
+    struct PackedVertex {
+        GLushort position[4];
+        // two snorm16 (octahedral) or one GL_INT_2_10_10_10_REV
+        GLuint normal;
+        GLushort texCoords[2];
+    };
+
+    // Maps the decoded attribute back to object space: position = vPosition * scale + bias
+    struct VertexDecode {
+        glm::vec3 positionScale;
+        glm::vec3 positionBias;
+    };
+
+    // Largest differences between the original and the decoded vertices
+    struct VertexFormatError {
+        float position;
+        float normalDegrees;
+        float texCoords;
+    };
+
+    const char* getVertexFormatName(VERTEX_FORMAT format);
+    // false if name is not full, oct16 or 1010102
+    bool ParseVertexFormat(const char* name, VERTEX_FORMAT& format);
+
+    GLsizei getVertexSize(VERTEX_FORMAT format);
+
+    // Appends the vertices in the given layout to output
+    VertexDecode PackVertices(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format, std::vector<unsigned char>& output);
+
+    // Attribute pointers 0 (position), 1 (normal) and 2 (UV) for the buffer bound to GL_ARRAY_BUFFER
+    void SetupVertexAttributes(VERTEX_FORMAT format);
+
+    // Position-only stream for depth passes: the position part of the format, with the same decode
+    GLsizei getPositionSize(VERTEX_FORMAT format);
+    VertexDecode PackPositions(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format, std::vector<unsigned char>& output);
+    // Attribute pointer 0 for a position-only buffer bound to GL_ARRAY_BUFFER
+    void SetupPositionAttribute(VERTEX_FORMAT format);
+
+    // Packs and decodes the vertices on the CPU to measure the precision lost by the format
+    VertexFormatError MeasureVertexError(const std::vector<gps::Vertex>& vertices, VERTEX_FORMAT format);
+
+    glm::vec2 OctahedralEncode(glm::vec3 normal);
+    glm::vec3 OctahedralDecode(glm::vec2 encoded);
+
+    GLushort FloatToHalf(float value);
+    float HalfToFloat(GLushort value);
+}
+
+#endif /* VertexFormat_hpp */
@@ -2,14 +2,12 @@
 
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, bool preferGL43) {
         if (!glfwInit()) {
             throw std::runtime_error("Could not start GLFW3!");
         }
 
         //window hints
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -17,20 +15,100 @@ namespace gps {
         glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
         // for multisampling/antialising
-        glfwWindowHint(GLFW_SAMPLES, 4);
+        glfwWindowHint(GLFW_SAMPLES, SAMPLES);
 
-        this->window = glfwCreateWindow(width, height, title, NULL, NULL);
+        this->window = CreateContextWindow(width, height, title, preferGL43);
         if (!this->window) {
             throw std::runtime_error("Could not create GLFW3 window!");
         }
 
+        InitContext();
+    }
+
+    void Window::CreateHeadless(int width, int height, bool preferGL43) {
+#ifdef GLFW_PLATFORM_NULL
+        // no display connection at all, contexts come from EGL or OSMesa
+        if (glfwPlatformSupported(GLFW_PLATFORM_NULL))
+            glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+        if (!glfwInit()) {
+            throw std::runtime_error("Could not start GLFW3!");
+        }
+
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        this->window = NULL;
+#ifdef GLFW_OSMESA_CONTEXT_API
+        // EGL (GPU drivers, Mesa) first, then OSMesa for software rendering. GLEW loads the
+        // functions through WGL or GLX, it may not find them in these contexts.
+        const int contextApis[] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+        const char* contextApiNames[] = { "EGL", "OSMesa" };
+        for (int i = 0; i < 2 && !this->window; i++) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApis[i]);
+            this->window = CreateContextWindow(width, height, "headless", preferGL43);
+            if (!this->window)
+                continue;
+            this->contextApiName = contextApiNames[i];
+            try {
+                InitContext();
+            }
+            catch (const std::runtime_error& e) {
+                std::cout << e.what() << std::endl;
+                glfwMakeContextCurrent(NULL);
+                glfwDestroyWindow(this->window);
+                this->window = NULL;
+            }
+        }
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+#endif
+        if (!this->window) {
+            this->window = CreateContextWindow(width, height, "headless", preferGL43);
+            if (!this->window) {
+                throw std::runtime_error("Could not create a headless GL context!");
+            }
+            this->contextApiName = "hidden window";
+            InitContext();
+        }
+        std::cout << "Headless context: " << this->contextApiName << std::endl;
+        // whatever size the hidden window got, the frames are rendered at the asked size
+        this->dimensions.width = width;
+        this->dimensions.height = height;
+    }
+
+    GLFWwindow* Window::CreateContextWindow(int width, int height, const char *title, bool preferGL43) {
+        // try a 4.3 context first (multi draw indirect), fall back to 4.1
+        GLFWwindow* created = NULL;
+        if (preferGL43) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            created = glfwCreateWindow(width, height, title, NULL, NULL);
+        }
+        if (!created) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+            created = glfwCreateWindow(width, height, title, NULL, NULL);
+        }
+        return created;
+    }
+
+    void Window::InitContext() {
         glfwMakeContextCurrent(window);
 
         glfwSwapInterval(1);
 
         // start GLEW extension handler
         glewExperimental = GL_TRUE;
-        glewInit();
+        GLenum glewError = glewInit();
+        if (glewError != GLEW_OK) {
+            throw std::runtime_error(std::string("Could not load the OpenGL functions of the ") + this->contextApiName
+                + " context: " + (const char*)glewGetErrorString(glewError));
+        }
+        // GLEW may accept a context whose functions its loader does not see
+        if (glGenFramebuffers == NULL || glBlitFramebuffer == NULL) {
+            throw std::runtime_error(std::string("Could not load the OpenGL 4 functions of the ") + this->contextApiName + " context");
+        }
 
         // get version info
         const GLubyte* renderer = glGetString(GL_RENDERER); // get renderer string
@@ -38,6 +116,9 @@ namespace gps {
         std::cout << "Renderer: " << renderer << std::endl;
         std::cout << "OpenGL version: " << version << std::endl;
 
+        glGetIntegerv(GL_MAJOR_VERSION, &this->contextVersion.major);
+        glGetIntegerv(GL_MINOR_VERSION, &this->contextVersion.minor);
+
         //for RETINA display
         glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
     }
@@ -49,6 +130,10 @@ namespace gps {
         glfwTerminate();
     }
 
+    const char* Window::getContextApiName() const {
+        return contextApiName;
+    }
+
     GLFWwindow* Window::getWindow() {
         return this->window;
     }
@@ -57,6 +142,10 @@ namespace gps {
         return this->dimensions;
     }
 
+    ContextVersion Window::getContextVersion() {
+        return this->contextVersion;
+    }
+
     void Window::setWindowDimensions(WindowDimensions dimensions) {
         this->dimensions = dimensions;
     }
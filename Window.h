@@ -11,21 +11,43 @@ struct WindowDimensions {
     int height;
 };
 
+struct ContextVersion {
+    int major;
+    int minor;
+};
+
 namespace gps {
 
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // multisampling of the window, the headless target uses the same
+        static const int SAMPLES = 4;
+
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool preferGL43=false);
+        // GL context without a visible window, the frames have to go to a framebuffer object.
+        // Tries EGL and OSMesa (GLFW 3.3+) before a hidden window, without a display on GLFW 3.4+.
+        // A context GLEW can not load the GL functions for is dropped and the next one tried.
+        void CreateHeadless(int width, int height, bool preferGL43=false);
         void Delete();
 
         GLFWwindow* getWindow();
         WindowDimensions getWindowDimensions();
+        ContextVersion getContextVersion();
+        // how the context was created: "native", "EGL", "OSMesa" or "hidden window"
+        const char* getContextApiName() const;
         void setWindowDimensions(WindowDimensions dimensions);
 
     private:
+        // the 4.3 or 4.1 core context with the current hints, NULL if both fail
+        GLFWwindow* CreateContextWindow(int width, int height, const char *title, bool preferGL43);
+        // makes the context current and loads the GL functions, throws if GLEW can not
+        void InitContext();
+
         WindowDimensions dimensions;
+        ContextVersion contextVersion;
         GLFWwindow *window;
+        const char* contextApiName = "native";
     };
 }
 
@@ -13,8 +13,35 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
+#include "StaticBatch.hpp"
+#include "Bvh.hpp"
+#include "GpuProfiler.hpp"
+#include "CpuProfiler.hpp"
+#include "DrawList.hpp"
+#include "JobSystem.hpp"
+#include "SceneGraph.hpp"
+#include "TransformSystem.hpp"
+#include "ClusteredLights.hpp"
+#include "GBuffer.hpp"
+#include "ShadowCascades.hpp"
+#include "SimulationClock.hpp"
+#include "TripleBuffer.hpp"
+#include "FramePacer.hpp"
+#include "OffscreenTarget.hpp"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 // window
 gps::Window myWindow;
@@ -25,7 +52,6 @@ glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
 glm::mat3 normalMatrix;
-glm::mat4 bladesMatrix;
 
 // light parameters
 glm::vec3 lightDir;
@@ -37,12 +63,26 @@ GLint modelLoc;
 GLint viewLoc;
 GLint projectionLoc;
 GLint normalMatrixLoc;
-GLint lightDirLoc;
 GLint lightColorLoc;
 GLint lightPosEyeLoc;
 
-int fog = 0;
-GLfloat fogLoc, fogLocSkyBox;
+// Keyboard toggles. The simulation thread changes controls and copies them into every snapshot,
+// the render thread draws with the settings of the snapshot it took.
+struct RenderSettings {
+    int fog = 0;
+    bool animation = false;
+    bool showStats = false;
+    bool useIndirect = false;
+    bool occlusionEnabled = true;
+    bool lodEnabled = true;
+    bool depthPrepass = false;
+    bool deferredShading = false;
+    bool shadowsEnabled = true;
+    bool nightMode = false;
+    GLenum polygonMode = GL_FILL;
+};
+RenderSettings controls;
+RenderSettings settings;
 
 // camera
 gps::Camera myCamera(
@@ -53,15 +93,62 @@ gps::Camera myCamera(
 float lastX, lastY;
 float pitch, yaw;
 bool firstMouse = true;
-bool animation = false;
 bool selfMove = false;
 bool show = true;
 int showTime = 0;
 float bladesMovement = 0.0f;
 
+// movement amounts are per simulation step (60 per second)
 GLfloat cameraSpeed = 0.75f, sensitivity = 0.1f;
 
+// fixed timestep simulation, frames render a blend of the last two steps
+gps::SimulationClock simulationClock;
+glm::vec3 previousCameraPosition;
+float previousBladesMovement = 0.0f;
+// rotation done by the last step, the mouse turns the camera right away and is not interpolated
+float stepYaw = 0.0f;
+float stepPitch = 0.0f;
+float renderBladesMovement = 0.0f;
+
+// What the render thread needs from the simulation, published after every step and every input.
+// The camera and the blades are kept from the previous and the last step to blend between them.
+struct FrameSnapshot {
+    glm::vec3 previousPosition;
+    glm::vec3 position;
+    float previousPitch, pitch;
+    float previousYaw, yaw;
+    float previousBlades, blades;
+    // see SimulationClock::getStepTime
+    double stepTime;
+    // newest input the snapshot shows and its sequence number, for the input to present latency
+    double inputTime;
+    unsigned long long inputSequence;
+    bool tourRunning;
+    RenderSettings settings;
+};
+gps::TripleBuffer<FrameSnapshot> snapshots;
+// GL context and swaps, the main thread keeps the window events and the simulation
+std::thread renderThread;
+// cleared when the window closes, or by the render thread at the end of the tour benchmark
+std::atomic<bool> running(true);
+// the render thread's copy of the snapshot it draws
+FrameSnapshot renderedFrame;
+
+// frame pacing of the render thread, --pacing=vsync|adaptive|uncapped|fixed and --fps=N for fixed
+gps::FramePacer framePacer;
+gps::PACING_MODE pacingMode = gps::PACING_VSYNC;
+double fixedFrameRate = 60.0;
+// --late-latch: the view comes from the newest snapshot right before the draws are submitted
+bool lateLatching = false;
+
 GLboolean pressedKeys[1024];
+// when the last input arrived and how many so far, set by the callbacks
+double lastInputTime = 0.0;
+unsigned long long inputSequence = 0;
+// the same for the newest input the next frame shows: the mouse and the toggles act at once,
+// the movement keys only once a simulation step has moved the camera with them
+double appliedInputTime = 0.0;
+unsigned long long appliedInputSequence = 0;
 
 // models
 gps::Model3D scene;
@@ -70,7 +157,13 @@ gps::Model3D blades1;
 gps::Model3D blades2;
 gps::Model3D blades3;
 gps::Model3D windmillBlades;
-GLfloat angle;
+
+// placement of the models (windmill -> hub -> rotor), read from a file
+gps::SceneGraph sceneGraph;
+// nodes spun by the animation
+std::vector<int> rotorNodes;
+// GPU vertex layout of all models, --vertex-format=full|oct16|1010102
+gps::VERTEX_FORMAT vertexFormat = gps::VERTEX_FORMAT_OCT16;
 
 // shaders
 gps::Shader myBasicShader;
@@ -79,6 +172,87 @@ gps::Shader myBasicShader;
 gps::SkyBox skyBox;
 gps::Shader skyBoxShader;
 
+//static scene drawn with multi draw indirect (GL 4.3+)
+gps::StaticBatch sceneBatch;
+gps::Shader myIndirectShader;
+bool indirectSupported = false;
+
+// view-frustum culling
+gps::Frustum frustum;
+gps::CullStats cullStats;
+double lastStatsTime = 0.0;
+
+// spatial index over the scene meshes (culling, picking)
+gps::SceneBvh sceneBvh;
+
+// software occlusion culling against the big scene meshes
+gps::OcclusionCuller occlusionCuller;
+// meshes with a bounding sphere at least this big are rendered as occluders
+const float OCCLUDER_MIN_RADIUS = 10.0f;
+
+// level of detail picked per mesh from its projected simplification error estimate
+gps::LodSettings lodSettings;
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// depth-only pre-pass over a position-only stream, the main pass then shades only visible fragments
+gps::Shader myDepthShader;
+gps::Shader myDepthIndirectShader;
+
+// deferred shading (X, --deferred): the main pass fills the G-buffer, a screen pass does the lighting
+gps::GBuffer gBuffer;
+gps::Shader myGBufferShader;
+gps::Shader myGBufferIndirectShader;
+gps::Shader myLightingShader;
+
+// cascaded shadow maps of the sun (H), the far cascades only hold the static nodes and are cached
+gps::ShadowCascades shadowCascades;
+const float SHADOW_DISTANCE = 250.0f;
+std::vector<gps::SceneInstance> shadowInstances;
+std::vector<gps::SceneInstance> staticShadowInstances;
+// nodes moved by the animation, the rotors and everything below them
+std::vector<bool> dynamicNodes;
+
+// GPU time of the passes of every frame, --gpu-profile=file.csv|file.json writes the totals at exit
+gps::GpuProfiler gpuProfiler;
+const char* gpuProfileFile = NULL;
+// T captures this many frames of CPU scopes to TRACE_FILE, --trace=N the startup and the first N frames
+const int TRACE_FRAMES = 60;
+const char* TRACE_FILE = "trace.json";
+
+// per-frame draw packets, built by the worker threads and played back on the GL thread
+gps::JobSystem jobSystem;
+std::vector<gps::SceneInstance> sceneInstances;
+gps::DrawList drawList;
+
+// night scene lit by point lamps (N), binned into view clusters every frame
+gps::ClusteredLights clusteredLights;
+std::vector<gps::PointLight> pointLights;
+const size_t DEFAULT_POINT_LIGHTS = 256;
+
+// projection of the scene, the light clusters are built for the same one
+const float fieldOfView = 45.0f;
+const float nearPlane = 0.1f;
+const float farPlane = 400.0f;
+
+// --bench-tour: plays the self-moving camera tour once and prints the average GPU time per frame
+bool tourBenchmark = false;
+double tourDepthMs = 0.0;
+double tourColorMs = 0.0;
+double tourLightingMs = 0.0;
+int tourFrames = 0;
+
+// --headless: the tour without a window, one fixed step per frame into an offscreen target at
+// --resolution=WxH, prints the frame time percentiles and writes them as JSON to --result=file
+bool headless = false;
+int headlessWidth = 1920;
+int headlessHeight = 1080;
+const char* headlessResultFile = NULL;
+// not timed, the first frames compile shader variants and fill the caches
+const int HEADLESS_WARMUP_FRAMES = 10;
+gps::OffscreenTarget offscreenTarget;
+// where the frames end up, the window or the offscreen target
+GLuint outputFramebuffer = 0;
+
 GLenum glCheckError_(const char* file, int line)
 {
     GLenum errorCode;
@@ -117,7 +291,29 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
     fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
 }
 
+// GLFW has no event times, the callbacks stamp the events when they get them
+void stampInput() {
+    lastInputTime = glfwGetTime();
+    inputSequence++;
+}
+
+// everything stamped so far is in the state the next snapshot carries
+void applyInput() {
+    appliedInputTime = lastInputTime;
+    appliedInputSequence = inputSequence;
+}
+
+// held keys read by processMovement
+bool isMovementKey(int key) {
+    return key == GLFW_KEY_W || key == GLFW_KEY_A || key == GLFW_KEY_S || key == GLFW_KEY_D
+        || key == GLFW_KEY_Q || key == GLFW_KEY_E;
+}
+
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
+    stampInput();
+    if (!isMovementKey(key))
+        applyInput();
+
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
@@ -128,36 +324,25 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 
     //Start/stop animations
     if (key == GLFW_KEY_M && action == GLFW_PRESS) {
-        animation = !animation;
+        controls.animation = !controls.animation;
     }
 
     //Wireframe
     if (key == GLFW_KEY_J && action == GLFW_PRESS) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        controls.polygonMode = GL_LINE;
     }
     //Normal
     if (key == GLFW_KEY_K && action == GLFW_PRESS) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        controls.polygonMode = GL_FILL;
     }
     //Points
     if (key == GLFW_KEY_L && action == GLFW_PRESS) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+        controls.polygonMode = GL_POINT;
     }
 
     //fog
     if (key == GLFW_KEY_F && action == GLFW_RELEASE) {
-        fog = 1 - fog;
-
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-        glUniform1i(fogLoc, fog);
-        skyBoxShader.useShaderProgram();
-        glUniform1i(fogLocSkyBox, fog);
-
+        controls.fog = 1 - controls.fog;
     }
 
     //self moving camera
@@ -165,6 +350,70 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         selfMove = !selfMove;
     }
 
+    //print culling statistics
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        controls.showStats = !controls.showStats;
+    }
+
+    //toggle software occlusion culling
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        controls.occlusionEnabled = !controls.occlusionEnabled;
+        std::cout << "Occlusion culling: " << (controls.occlusionEnabled ? "on" : "off") << std::endl;
+    }
+
+    //toggle the levels of detail
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        controls.lodEnabled = !controls.lodEnabled;
+        std::cout << "Levels of detail: " << (controls.lodEnabled ? "on" : "off") << std::endl;
+    }
+
+    //toggle the night scene with the point lights
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        controls.nightMode = !controls.nightMode;
+        std::cout << "Night (" << pointLights.size() << " point lights): " << (controls.nightMode ? "on" : "off") << std::endl;
+    }
+
+    //toggle the depth pre-pass
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        controls.depthPrepass = !controls.depthPrepass;
+        std::cout << "Depth pre-pass: " << (controls.depthPrepass ? "on" : "off") << std::endl;
+    }
+
+    //pick the scene mesh in the center of the screen
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        gps::Ray ray;
+        ray.origin = myCamera.getPosition();
+        ray.direction = myCamera.getFrontDirection();
+        gps::RayHit hit;
+        if (sceneBvh.Raycast(ray, hit))
+            std::cout << "Picked mesh " << hit.mesh << ", triangle " << hit.triangle << " at distance " << hit.distance << std::endl;
+        else
+            std::cout << "Nothing picked" << std::endl;
+    }
+
+    //capture a CPU trace
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        gps::CpuProfiler::StartCapture(TRACE_FRAMES, TRACE_FILE);
+    }
+
+    //toggle the shadows
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        controls.shadowsEnabled = !controls.shadowsEnabled;
+        std::cout << "Shadows: " << (controls.shadowsEnabled ? "on" : "off") << std::endl;
+    }
+
+    //toggle between forward and deferred shading
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        controls.deferredShading = !controls.deferredShading;
+        std::cout << "Shading: " << (controls.deferredShading ? "deferred" : "forward") << std::endl;
+    }
+
+    //toggle multi draw indirect for the static scene
+    if (key == GLFW_KEY_B && action == GLFW_PRESS && indirectSupported) {
+        controls.useIndirect = !controls.useIndirect;
+        std::cout << "Multi draw indirect: " << (controls.useIndirect ? "on" : "off") << std::endl;
+    }
+
     if (key >= 0 && key < 1024) {
         if (action == GLFW_PRESS) {
             pressedKeys[key] = true;
@@ -177,6 +426,8 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+    stampInput();
+    applyInput();
 
     if (firstMouse) {
         lastX = xpos;
@@ -200,72 +451,46 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
         pitch = -89.0f;
 
     myCamera.rotate(pitch, yaw);
-
-    view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 }
 
+// one simulation step of the keyboard controls, the view is rebuilt for every rendered frame
 void processMovement() {
+    CPU_SCOPE("processMovement");
     if (pressedKeys[GLFW_KEY_W]) {
         myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_S]) {
         myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_A]) {
         myCamera.move(gps::MOVE_LEFT, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_D]) {
         myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
-        //update view matrix
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_Q]) {
         yaw += 1.0;
         myCamera.rotate(pitch, yaw);
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_E]) {
         yaw -= 1.0;
         myCamera.rotate(pitch, yaw);
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 }
 
 void initOpenGLWindow() {
-    myWindow.Create(1920, 1080, "Proiect Prelucrare Grafica Nicoara Cristian-Catalin");
+    if (headless) {
+        myWindow.CreateHeadless(headlessWidth, headlessHeight, true);
+        retina_width = myWindow.getWindowDimensions().width;
+        retina_height = myWindow.getWindowDimensions().height;
+        return;
+    }
+    myWindow.Create(1920, 1080, "Proiect Prelucrare Grafica Nicoara Cristian-Catalin", true);
     glfwGetFramebufferSize(myWindow.getWindow(), &retina_width, &retina_height);
 }
 
@@ -299,16 +524,16 @@ void initSkyBox()
 
 
     skyBox.Load(faces);
+    // SkyBox::Draw sets view and projection, binding the program here would wait for its compile
     skyBoxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
-    skyBoxShader.useShaderProgram();
-    view = myCamera.getViewMatrix();
-    glUniformMatrix4fv(glGetUniformLocation(skyBoxShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-
-    projection = glm::perspective(glm::radians(90.0f), (float)retina_width / (float)retina_height, 0.1f, 75.0f);
-    glUniformMatrix4fv(glGetUniformLocation(skyBoxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 }
 
 void initModels() {
+    CPU_SCOPE("initModels");
+    gps::Model3D* models[] = { &scene, &blades, &blades1, &blades2, &blades3, &windmillBlades };
+    for (int i = 0; i < 6; i++)
+        models[i]->setVertexFormat(vertexFormat);
+
     scene.LoadModel("models/objects/scena1.obj");
     blades.LoadModel("models/objects/Blades.obj");
     blades1.LoadModel("models/objects/Blades1.obj");
@@ -317,17 +542,175 @@ void initModels() {
     windmillBlades.LoadModel("models/objects/WindmillBlades.obj");
 }
 
+void initSceneGraph() {
+    std::map<std::string, gps::Model3D*> models;
+    models["scene"] = &scene;
+    models["blades"] = &blades;
+    models["blades1"] = &blades1;
+    models["blades2"] = &blades2;
+    models["blades3"] = &blades3;
+    models["windmillBlades"] = &windmillBlades;
+    // every pass draws the graph, there is nothing to show without it
+    if (!sceneGraph.Load("models/scene.txt", models))
+        throw std::runtime_error("Could not load the scene graph models/scene.txt!");
+
+    const std::vector<gps::SceneNode>& nodes = sceneGraph.getNodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].name.compare(0, 5, "rotor") == 0)
+            rotorNodes.push_back((int)i);
+    }
+
+    // parents come before their children
+    dynamicNodes.assign(nodes.size(), false);
+    for (size_t i = 0; i < rotorNodes.size(); i++)
+        dynamicNodes[rotorNodes[i]] = true;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].parent >= 0 && dynamicNodes[nodes[i].parent])
+            dynamicNodes[i] = true;
+    }
+
+    int sceneNode = sceneGraph.findNode("scene");
+    model = sceneNode >= 0 ? sceneGraph.getNode(sceneNode).world : glm::mat4(1.0f);
+}
+
+// lamps scattered over the lower part of the scene, the same ones every run
+void initPointLights(size_t count) {
+    clusteredLights.Init();
+
+    gps::BoxList boxes;
+    std::vector<gps::Mesh>& meshes = scene.getMeshes();
+    for (size_t i = 0; i < meshes.size(); i++)
+        boxes.push(meshes[i].bounds, model);
+    if (boxes.size() == 0)
+        return;
+    glm::vec3 sceneMin(FLT_MAX), sceneMax(-FLT_MAX);
+    for (size_t i = 0; i < boxes.size(); i++) {
+        glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+        glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+        sceneMin = glm::min(sceneMin, center - extent);
+        sceneMax = glm::max(sceneMax, center + extent);
+    }
+
+    // each lamp reaches a bit past its share of the ground, so neighbouring lamps overlap
+    float spacing = std::sqrt((sceneMax.x - sceneMin.x) * (sceneMax.z - sceneMin.z) / (float)std::max(count, (size_t)1));
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    pointLights.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        pointLights[i].position = glm::vec3(
+            sceneMin.x + unit(random) * (sceneMax.x - sceneMin.x),
+            sceneMin.y + unit(random) * 0.2f * (sceneMax.y - sceneMin.y),
+            sceneMin.z + unit(random) * (sceneMax.z - sceneMin.z));
+        pointLights[i].radius = spacing * (1.0f + unit(random));
+        pointLights[i].color = glm::vec3(1.0f, 0.6f + 0.3f * unit(random), 0.3f + 0.3f * unit(random));
+    }
+}
+
+void initOcclusionCuller() {
+    occlusionCuller.Init();
+
+    std::vector<gps::Mesh>& meshes = scene.getMeshes();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (meshes[i].sphere.radius >= OCCLUDER_MIN_RADIUS)
+            // full detail, simplified levels can bulge out of the surface and hide what is behind it
+            occlusionCuller.AddOccluder(meshes[i].vertices, meshes[i].getLodIndices(0), model);
+    }
+    std::cout << "Occluder triangles : " << occlusionCuller.getOccluderTriangleCount() << std::endl;
+}
+
+const gps::OcclusionCuller* activeOcclusion() {
+    return settings.occlusionEnabled ? &occlusionCuller : NULL;
+}
+
+const gps::LodSettings* activeLod() {
+    return settings.lodEnabled ? &lodSettings : NULL;
+}
+
+void updateLodSettings() {
+    lodSettings.cameraPosition = myCamera.getPosition();
+    lodSettings.projectionScale = (float)retina_height / (2.0f * tanf(glm::radians(45.0f) * 0.5f));
+    lodSettings.threshold = LOD_PIXEL_ERROR;
+}
+
+void initSceneBvh() {
+    sceneBvh.Build(scene, model);
+}
+
+bool hasArgument(int argc, const char* argv[], const char* argument) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], argument) == 0)
+            return true;
+    }
+    return false;
+}
+
+// value of an argument given as prefix + value, NULL if missing
+const char* getArgumentValue(int argc, const char* argv[], const char* prefix) {
+    size_t length = strlen(prefix);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], prefix, length) == 0)
+            return argv[i] + length;
+    }
+    return NULL;
+}
+
 void initShaders() {
+    CPU_SCOPE("initShaders");
     myBasicShader.loadShader(
         "shaders/basic.vert",
         "shaders/basic.frag");
+
+    myDepthShader.loadShader(
+        "shaders/depth.vert",
+        "shaders/depth.frag");
+
+    myGBufferShader.loadShader(
+        "shaders/basic.vert",
+        "shaders/gbuffer.frag");
+    myLightingShader.loadShader(
+        "shaders/deferred.vert",
+        "shaders/deferred.frag");
+
+    indirectSupported = gps::StaticBatch::isSupported();
+    if (indirectSupported) {
+        myIndirectShader.loadShader(
+            "shaders/basicIndirect.vert",
+            "shaders/basic.frag");
+        myDepthIndirectShader.loadShader(
+            "shaders/depthIndirect.vert",
+            "shaders/depth.frag");
+        myGBufferIndirectShader.loadShader(
+            "shaders/basicIndirect.vert",
+            "shaders/gbuffer.frag");
+    }
+    // the sky box shaders are loaded before, so this covers every program used at startup.
+    // Nothing waited for the compiles yet, initUniforms is the first to use a program.
+    std::cout << "Shader programs: " << gps::Shader::getCompiledCount() << " compiled, "
+        << gps::Shader::getCachedCount() << " from the binary cache, "
+        << gps::Shader::getLoadMilliseconds() << " ms" << std::endl;
+}
+
+void initStaticBatch() {
+    if (!indirectSupported)
+        return;
+
+    sceneBatch.Add(scene, model);
+    sceneBatch.Upload();
+    controls.useIndirect = true;
+}
+
+// finishes the shader compiles that are done (logs, binary cache) without waiting for the others
+void pollShaders() {
+    gps::Shader* shaders[] = { &myBasicShader, &myDepthShader, &myIndirectShader, &myDepthIndirectShader, &skyBoxShader,
+        &myGBufferShader, &myGBufferIndirectShader, &myLightingShader };
+    for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); i++)
+        shaders[i]->pollCompletion();
 }
 
 void initUniforms() {
     myBasicShader.useShaderProgram();
 
-    // create model matrix
-    model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    // model matrix of the static scene comes from the scene graph
     modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
     // get view matrix for current camera
@@ -341,18 +724,15 @@ void initUniforms() {
     normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
     // create projection matrix
-    projection = glm::perspective(glm::radians(45.0f),
+    projection = glm::perspective(glm::radians(fieldOfView),
         (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-        0.1f, 400.0f);
+        nearPlane, farPlane);
     projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
     // send projection matrix to shader
     glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-    //set the light direction (direction towards the light)
+    //set the light direction (direction towards the light), sent in eye space every frame
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-    // send light dir to shader
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
     //set light color
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
@@ -365,130 +745,112 @@ void initUniforms() {
     // send light position to shader
     glUniform3fv(lightPosEyeLoc, 1, glm::value_ptr(lightPosEye));
 
-    fogLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fog");
-    glUniform1i(fogLoc, fog);
-
-    skyBoxShader.useShaderProgram();
-    fogLocSkyBox = glGetUniformLocation(skyBoxShader.shaderProgram, "fog");
-    glUniform1i(fogLocSkyBox, fog);
-}
-
-void renderBlade(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send blades model matrix data to shader
-
-    bladesMatrix = glm::mat4(1.0f);
-    bladesMatrix = glm::translate(bladesMatrix, glm::vec3(125.444f, 35.511f, 79.00f));
-    bladesMatrix = glm::rotate(bladesMatrix, glm::radians(bladesMovement), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bladesMatrix));
-
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * bladesMatrix));
-    //send blades normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw objects
-
-    blades.Draw(shader);
-}
-
-void renderBlade1(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send blades model matrix data to shader
-
-    bladesMatrix = glm::mat4(1.0f);
-    bladesMatrix = glm::translate(bladesMatrix, glm::vec3(43.80f, 35.511f, 77.881f));
-    bladesMatrix = glm::rotate(bladesMatrix, glm::radians(bladesMovement), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bladesMatrix));
-
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * bladesMatrix));
-    //send blades normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw objects
-
-    blades1.Draw(shader);
-}
-
-void renderBlade2(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send blades model matrix data to shader
-
-    bladesMatrix = glm::mat4(1.0f);
-    bladesMatrix = glm::translate(bladesMatrix, glm::vec3(54.434f, 35.511f, -89.514f));
-    bladesMatrix = glm::rotate(bladesMatrix, glm::radians(bladesMovement), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bladesMatrix));
-
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * bladesMatrix));
-    //send blades normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw objects
-    blades2.Draw(shader);
+    if (indirectSupported) {
+        // per-draw model matrices come from the batch
+        myIndirectShader.useShaderProgram();
+        glUniformMatrix4fv(glGetUniformLocation(myIndirectShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3fv(glGetUniformLocation(myIndirectShader.shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
+        glUniform3fv(glGetUniformLocation(myIndirectShader.shaderProgram, "lightPosEye"), 1, glm::value_ptr(lightPosEye));
+    }
 }
 
-void renderBlade3(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send blades model matrix data to shader
-
-    bladesMatrix = glm::mat4(1.0f);
-    bladesMatrix = glm::translate(bladesMatrix, glm::vec3(124.673f, 35.511f, -98.123f));
-    bladesMatrix = glm::rotate(bladesMatrix, glm::radians(bladesMovement), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bladesMatrix));
-
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * bladesMatrix));
-    //send blades normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw objects
-    blades3.Draw(shader);
+// Collects the models to draw this frame. Only the spinning rotors get new world matrices,
+// the rest of the graph is cached.
+void updateSceneInstances() {
+    CPU_SCOPE("updateSceneInstances");
+    if (settings.animation) {
+        for (size_t i = 0; i < rotorNodes.size(); i++)
+            sceneGraph.setRotation(rotorNodes[i], glm::vec3(0.0f, 0.0f, renderBladesMovement));
+    }
+    sceneGraph.Update();
+
+    sceneInstances.clear();
+    shadowInstances.clear();
+    staticShadowInstances.clear();
+    const std::vector<gps::SceneNode>& nodes = sceneGraph.getNodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        // the cached shadow cascades have to be redrawn when static geometry moves
+        if (!dynamicNodes[i] && nodes[i].worldChanged)
+            shadowCascades.invalidateStatic();
+        if (nodes[i].model == NULL)
+            continue;
+
+        gps::SceneInstance instance;
+        instance.model = nodes[i].model;
+        instance.modelMatrix = nodes[i].world;
+        instance.normalMatrix = nodes[i].worldNormal;
+        shadowInstances.push_back(instance);
+        if (!dynamicNodes[i])
+            staticShadowInstances.push_back(instance);
+        // with multi draw indirect the static scene is drawn by its batch
+        if (!(settings.useIndirect && nodes[i].model == &scene))
+            sceneInstances.push_back(instance);
+    }
 }
 
-void renderWindmillBlade(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send blades model matrix data to shader
-
-    bladesMatrix = glm::mat4(1.0f);
-    bladesMatrix = glm::translate(bladesMatrix, glm::vec3(35.317f, 16.916f, 16.683f));
-    bladesMatrix = glm::rotate(bladesMatrix, glm::radians(bladesMovement), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bladesMatrix));
-
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * bladesMatrix));
-    //send blades normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-    // draw objects
-    windmillBlades.Draw(shader);
+// Shader features that depend on the global state rather than on the material
+unsigned int sceneFeatures() {
+    return (settings.fog ? gps::SHADER_FOG : 0) | (settings.nightMode ? gps::SHADER_POINT_LIGHTS : 0) | (settings.shadowsEnabled ? gps::SHADER_SHADOWS : 0);
 }
 
-void renderObjects(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send scene model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Uniforms shared by all draws of the frame go to every variant of the scene shaders. The variants
+// this frame needs are compiled first, so the lazily created ones get them too.
+void updateFrameUniforms() {
+    CPU_SCOPE("updateFrameUniforms");
+    if (settings.deferredShading) {
+        drawList.PrepareShader(myGBufferShader, 0);
+        if (settings.useIndirect) {
+            sceneBatch.PrepareShader(myGBufferIndirectShader, 0);
+        }
+        myLightingShader.getVariant(sceneFeatures());
+    }
+    else {
+        drawList.PrepareShader(myBasicShader, sceneFeatures());
+        if (settings.useIndirect) {
+            sceneBatch.PrepareShader(myIndirectShader, sceneFeatures());
+        }
+    }
 
-    //send scene normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    // the light direction only changes with the camera, so it goes to eye space here and not per fragment
+    glm::vec3 lightDirEye = glm::normalize(glm::mat3(view) * lightDir);
+    // the batch has its per-draw normal matrices in world space
+    glm::mat3 viewNormalMatrix = glm::mat3(glm::inverseTranspose(view));
+    // the lamps take over at night
+    glm::vec3 sunColor = settings.nightMode ? lightColor * 0.1f : lightColor;
+
+    if (settings.nightMode) {
+        clusteredLights.setProjection(glm::radians(fieldOfView), (float)retina_width / (float)retina_height, nearPlane, farPlane);
+        clusteredLights.Build(pointLights, view);
+        clusteredLights.Upload();
+        clusteredLights.BindTextures();
+    }
+    if (settings.shadowsEnabled) {
+        shadowCascades.BindTexture();
+    }
 
-    // draw scene
-    scene.Draw(shader);
+    // the lighting pass takes the lights, the G-buffer pass only the matrices
+    gps::Shader* shaders[] = { &myBasicShader, &myGBufferShader, &myLightingShader, &myIndirectShader, &myGBufferIndirectShader };
+    int shaderCount = indirectSupported ? 5 : 3;
+    for (int s = 0; s < shaderCount; s++) {
+        std::vector<GLuint> programs = shaders[s]->getVariants();
+        for (size_t i = 0; i < programs.size(); i++) {
+            glUseProgram(programs[i]);
+            glUniformMatrix4fv(glGetUniformLocation(programs[i], "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(programs[i], "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+            glUniform3fv(glGetUniformLocation(programs[i], "lightDirEye"), 1, glm::value_ptr(lightDirEye));
+            glUniform3fv(glGetUniformLocation(programs[i], "lightColor"), 1, glm::value_ptr(sunColor));
+            glUniform3fv(glGetUniformLocation(programs[i], "lightPosEye"), 1, glm::value_ptr(lightPosEye));
+            if (settings.nightMode)
+                clusteredLights.setUniforms(programs[i], retina_width, retina_height);
+            if (settings.shadowsEnabled)
+                shadowCascades.setUniforms(programs[i], view);
+            if (shaders[s] == &myIndirectShader || shaders[s] == &myGBufferIndirectShader)
+                glUniformMatrix3fv(glGetUniformLocation(programs[i], "normalMatrix"), 1, GL_FALSE, glm::value_ptr(viewNormalMatrix));
+        }
+    }
 }
 
+// one simulation step of the camera tour, showTime counts steps
 void cameraMovement() {
     if (show) {
         if (showTime >= 0 && showTime < 150) {
@@ -563,10 +925,6 @@ void cameraMovement() {
                 myCamera.rotate(pitch, yaw);
             }
         }
-        view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
     if (showTime > 1200)
         show = false;
@@ -574,37 +932,404 @@ void cameraMovement() {
         showTime++;
 }
 
+// the G-buffer is written once by the main pass (more with overdraw) and read once by the lighting pass
+void printGBufferTraffic() {
+    double megabytes = (double)gBuffer.getWidth() * gBuffer.getHeight() * gps::GBuffer::getBytesPerPixel() / (1024.0 * 1024.0);
+    std::cout << "G-buffer: " << gBuffer.getWidth() << "x" << gBuffer.getHeight() << ", " << gps::GBuffer::getBytesPerPixel()
+        << " bytes per pixel, at least " << 2.0 * megabytes << " MB written and read per frame" << std::endl;
+}
+
+// screen space lights for the G-buffer, also copies its depth to the output for the sky box
+void renderLightingPass() {
+    CPU_SCOPE("renderLightingPass");
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+    myLightingShader.useVariant(sceneFeatures());
+    glUniformMatrix4fv(glGetUniformLocation(myLightingShader.shaderProgram, "inverseProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection)));
+    glUniformMatrix4fv(glGetUniformLocation(myLightingShader.shaderProgram, "inverseView"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+    gBuffer.BindTextures(myLightingShader.shaderProgram);
+
+    // deferred.frag writes the G-buffer depth
+    glDepthFunc(GL_ALWAYS);
+    gBuffer.DrawFullscreenTriangle();
+    glDepthFunc(GL_LESS);
+}
+
+void updateTourBenchmark(const FrameSnapshot& frame) {
+    if (!tourBenchmark || !running)
+        return;
+
+    if (frame.tourRunning) {
+        tourDepthMs += gpuProfiler.getLastMilliseconds("frame/depth pre-pass");
+        tourColorMs += gpuProfiler.getLastMilliseconds("frame/main pass");
+        tourLightingMs += gpuProfiler.getLastMilliseconds("frame/lighting pass");
+        tourFrames++;
+        return;
+    }
+
+    std::cout << "Camera tour (" << (settings.deferredShading ? "deferred" : "forward") << "): " << tourFrames
+        << " frames, GPU depth pre-pass " << tourDepthMs / tourFrames << " ms, main pass " << tourColorMs / tourFrames
+        << " ms, lighting pass " << tourLightingMs / tourFrames << " ms per frame" << std::endl;
+    if (settings.deferredShading)
+        printGBufferTraffic();
+    running = false;
+    glfwPostEmptyEvent();
+}
+
+// advances everything time dependent by one fixed step
+void simulationStep() {
+    CPU_SCOPE("simulationStep");
+    previousCameraPosition = myCamera.getPosition();
+    previousBladesMovement = bladesMovement;
+    float startYaw = yaw;
+    float startPitch = pitch;
+
+    processMovement();
+    applyInput();
+    if (controls.animation) {
+        bladesMovement = std::fmod(bladesMovement + 2.0f, 360.0f);
+    }
+    if (selfMove) {
+        cameraMovement();
+    }
+
+    stepYaw = yaw - startYaw;
+    stepPitch = pitch - startPitch;
+}
+
+// hands the state after the last step, with the input since, to the render thread
+void publishSnapshot() {
+    FrameSnapshot& frame = snapshots.getWriteSlot();
+    frame.previousPosition = previousCameraPosition;
+    frame.position = myCamera.getPosition();
+    frame.previousPitch = pitch - stepPitch;
+    frame.pitch = pitch;
+    frame.previousYaw = yaw - stepYaw;
+    frame.yaw = yaw;
+    frame.previousBlades = previousBladesMovement;
+    frame.blades = bladesMovement;
+    frame.stepTime = simulationClock.getStepTime();
+    frame.inputTime = appliedInputTime;
+    frame.inputSequence = appliedInputSequence;
+    frame.tourRunning = show;
+    frame.settings = controls;
+    snapshots.Publish();
+}
+
+// view and animation of the rendered frame, alpha of the way from the previous step to the last one
+void interpolateSimulation(const FrameSnapshot& frame, float alpha) {
+    glm::vec3 position = glm::mix(frame.previousPosition, frame.position, alpha);
+    view = myCamera.getViewMatrix(position, glm::mix(frame.previousPitch, frame.pitch, alpha), glm::mix(frame.previousYaw, frame.yaw, alpha));
+
+    float bladesStep = frame.blades - frame.previousBlades;
+    if (bladesStep < 0.0f)
+        bladesStep += 360.0f;
+    renderBladesMovement = frame.previousBlades + alpha * bladesStep;
+}
+
+// blend factor of a snapshot at the current time. The snapshot is older than a step if the
+// simulation thread was held up, it is not extrapolated.
+float snapshotAlpha(const FrameSnapshot& frame) {
+    float alpha = (float)((glfwGetTime() - frame.stepTime) / simulationClock.getStep());
+    return std::min(std::max(alpha, 0.0f), 1.0f);
+}
+
+// Late latching: the newest snapshot moves the camera right before the draws are submitted.
+// Culling and the shadow cascades keep the view the frame started with, the toggles stay too.
+void latchLateInput() {
+    if (!lateLatching)
+        return;
+    FrameSnapshot latest = snapshots.Read();
+    latest.settings = renderedFrame.settings;
+    latest.tourRunning = renderedFrame.tourRunning;
+    renderedFrame = latest;
+    interpolateSimulation(renderedFrame, snapshotAlpha(renderedFrame));
+}
+
 void renderScene() {
+    CPU_SCOPE("renderScene");
+    gpuProfiler.BeginFrame();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     //render the scene
 
+    cullStats.reset();
+    frustum.extract(projection * view);
+    updateLodSettings();
+    if (settings.occlusionEnabled) {
+        occlusionCuller.Render(projection * view);
+    }
+
+
+    // culling, levels of detail and matrices for the whole frame, both passes draw the same set
+    updateSceneInstances();
+    drawList.Build(sceneInstances, frustum, cullStats, jobSystem, activeOcclusion(), activeLod());
+    if (settings.useIndirect) {
+        sceneBatch.Cull(frustum, cullStats, activeOcclusion(), activeLod());
+    }
+    if (settings.shadowsEnabled) {
+        gpuProfiler.Begin("shadows");
+        shadowCascades.setProjection(glm::radians(fieldOfView), (float)retina_width / (float)retina_height, nearPlane, SHADOW_DISTANCE);
+        shadowCascades.Render(view, glm::normalize(lightDir), myDepthShader, shadowInstances, staticShadowInstances, jobSystem);
+        gpuProfiler.End();
+    }
+    latchLateInput();
+    updateFrameUniforms();
+
+    if (settings.deferredShading) {
+        // everything up to the lighting pass draws into the G-buffer, at the size of the viewport
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        gBuffer.Resize(viewport[2], viewport[3]);
+        gBuffer.BindFramebuffer();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
 
-    if (animation == true) {
-        if (bladesMovement >= 360)
-            bladesMovement = 0;
-        bladesMovement += 2;
+    if (settings.depthPrepass) {
+        gpuProfiler.Begin("depth pre-pass");
+        myDepthShader.useShaderProgram();
+        glUniformMatrix4fv(glGetUniformLocation(myDepthShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(myDepthShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        drawList.SubmitDepth(myDepthShader);
+        if (settings.useIndirect) {
+            myDepthIndirectShader.useShaderProgram();
+            glUniformMatrix4fv(glGetUniformLocation(myDepthIndirectShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(myDepthIndirectShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+            sceneBatch.DrawDepth(myDepthIndirectShader);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gpuProfiler.End();
+
+        // the depth buffer is final, only shade the fragments that match it
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    // the G-buffer only holds the materials, fog and lights are left to the lighting pass
+    gps::Shader& sceneShader = settings.deferredShading ? myGBufferShader : myBasicShader;
+    gps::Shader& batchShader = settings.deferredShading ? myGBufferIndirectShader : myIndirectShader;
+    unsigned int features = settings.deferredShading ? 0 : sceneFeatures();
+
+    // with multi draw indirect the draw list only has the rotors, the static batch the rest of the scene
+    gpuProfiler.Begin("main pass");
+    gpuProfiler.Begin("draw list");
+    drawList.Submit(sceneShader, view, features);
+    gpuProfiler.End();
+    if (settings.useIndirect) {
+        // the whole static scene with one multi draw call per material
+        gpuProfiler.Begin("static batch");
+        sceneBatch.Draw(batchShader, features);
+        gpuProfiler.End();
+    }
+    gpuProfiler.End();
+    if (settings.depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    if (settings.deferredShading) {
+        gpuProfiler.Begin("lighting pass");
+        renderLightingPass();
+        gpuProfiler.End();
     }
-    renderBlade(myBasicShader);
-    renderBlade1(myBasicShader);
-    renderBlade2(myBasicShader);
-    renderBlade3(myBasicShader);
-    renderWindmillBlade(myBasicShader);
-    renderObjects(myBasicShader);
+    gpuProfiler.Begin("sky box");
+    skyBoxShader.useVariant(sceneFeatures() & gps::SHADER_FOG);
     skyBox.Draw(skyBoxShader, view, projection);
-    if (selfMove) {
-        cameraMovement();
+    gpuProfiler.End();
+    gpuProfiler.EndFrame();
+}
+
+void printStats() {
+    double currentTime = glfwGetTime();
+    if (!settings.showStats || currentTime - lastStatsTime < 1.0)
+        return;
+    lastStatsTime = currentTime;
+    std::cout << "Meshes visible: " << cullStats.visible << " culled: " << cullStats.culled
+        << " occluded: " << cullStats.occluded << std::endl;
+    gpuProfiler.Print(std::cout);
+    if (settings.shadowsEnabled) {
+        std::cout << "Shadows: " << shadowCascades.getRenderedCount() << " of " << gps::ShadowCascades::CASCADE_COUNT
+            << " cascades redrawn, " << shadowCascades.getCasterCount() << " casters" << std::endl;
+    }
+    if (settings.deferredShading) {
+        printGBufferTraffic();
+    }
+    std::cout << "Draw list: " << drawList.getPackets().size() << " packets built in " << drawList.getBuildMilliseconds()
+        << " ms on " << jobSystem.getThreadCount() << " threads" << std::endl;
+    std::cout << "Frame pacing: " << gps::getPacingModeName(framePacer.getMode()) << (lateLatching ? ", late latching" : "")
+        << ", " << framePacer.getFrameMilliseconds() << " ms per frame, input to present " << framePacer.getLatencyMilliseconds()
+        << " ms (max " << framePacer.getMaxLatencyMilliseconds() << " ms)" << std::endl;
+    if (settings.nightMode) {
+        std::cout << "Point lights: " << clusteredLights.getVisibleLightCount() << " of " << pointLights.size()
+            << " in view, " << clusteredLights.getIndexCount() << " cluster entries, binned in "
+            << clusteredLights.getBuildMilliseconds() << " ms" << std::endl;
+    }
+}
+
+// Draws the newest snapshot over and over until the simulation stops. A slow swap or a GPU stall
+// only holds up this thread, the input and the steps go on and the next frame takes the latest state.
+void renderFrame() {
+    CPU_SCOPE("frame");
+    {
+        // the snapshot is taken after the wait, as late as possible
+        CPU_SCOPE("FramePacer::Wait");
+        framePacer.Wait();
+    }
+    renderedFrame = snapshots.Read();
+    settings = renderedFrame.settings;
+    glPolygonMode(GL_FRONT_AND_BACK, settings.polygonMode);
+
+    interpolateSimulation(renderedFrame, snapshotAlpha(renderedFrame));
+    renderScene();
+    printStats();
+    updateTourBenchmark(renderedFrame);
+    pollShaders();
+
+    {
+        CPU_SCOPE("FramePacer::Present");
+        framePacer.Present(renderedFrame.inputTime, renderedFrame.inputSequence);
+    }
+
+    glCheckError();
+}
+
+void renderLoop() {
+    gps::CpuProfiler::setThreadName("render");
+    glfwMakeContextCurrent(myWindow.getWindow());
+    framePacer.Init(myWindow.getWindow(), pacingMode, fixedFrameRate);
+    while (running) {
+        renderFrame();
+        gps::CpuProfiler::EndFrame();
+    }
+    glfwMakeContextCurrent(NULL);
+}
+
+// The whole frame on the main thread, from a snapshot of the last step without interpolation
+void renderHeadlessFrame() {
+    CPU_SCOPE("frame");
+    publishSnapshot();
+    renderedFrame = snapshots.Read();
+    settings = renderedFrame.settings;
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+    glPolygonMode(GL_FRONT_AND_BACK, settings.polygonMode);
+
+    interpolateSimulation(renderedFrame, 1.0f);
+    renderScene();
+    pollShaders();
+}
+
+// nearest rank percentile of sorted frame times
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+void printHeadlessResult(std::vector<double> frameMs) {
+    if (frameMs.empty()) {
+        std::cout << "ERROR: the headless benchmark rendered no frames" << std::endl;
+        return;
+    }
+    std::sort(frameMs.begin(), frameMs.end());
+    double total = 0.0;
+    for (size_t i = 0; i < frameMs.size(); i++)
+        total += frameMs[i];
+    double mean = total / frameMs.size();
+    const char* shading = settings.deferredShading ? "deferred" : "forward";
+
+    std::cout << "Headless tour (" << shading << ", " << headlessWidth << "x" << headlessHeight << ", " << offscreenTarget.getSamples()
+        << "x MSAA, " << myWindow.getContextApiName() << " context): " << frameMs.size()
+        << " frames, mean " << mean << " ms, p50 " << percentile(frameMs, 50.0) << " ms, p95 " << percentile(frameMs, 95.0)
+        << " ms, p99 " << percentile(frameMs, 99.0) << " ms, max " << frameMs.back() << " ms" << std::endl;
+
+    // one line, for scripts comparing runs
+    std::ostringstream json;
+    json << "{\"renderer\": \"" << glGetString(GL_RENDERER) << "\", \"context\": \"" << myWindow.getContextApiName()
+        << "\", \"shading\": \"" << shading << "\", \"width\": " << headlessWidth << ", \"height\": " << headlessHeight
+        << ", \"samples\": " << offscreenTarget.getSamples() << ", \"frames\": " << frameMs.size()
+        << ", \"meanMs\": " << mean << ", \"p50Ms\": " << percentile(frameMs, 50.0) << ", \"p95Ms\": " << percentile(frameMs, 95.0)
+        << ", \"p99Ms\": " << percentile(frameMs, 99.0) << ", \"maxMs\": " << frameMs.back() << "}";
+    std::cout << json.str() << std::endl;
+
+    if (headlessResultFile == NULL)
+        return;
+    std::ofstream file(headlessResultFile);
+    file << json.str() << std::endl;
+    if (file)
+        std::cout << "Result written to " << headlessResultFile << std::endl;
+    else
+        std::cout << "ERROR: could not write the result to " << headlessResultFile << std::endl;
+}
+
+// Plays the tour as fast as the GPU allows. Every frame is one simulation step and waits for the
+// GPU to finish, so the times do not depend on the machine's clock or on frames queued by the driver.
+void runHeadlessBenchmark() {
+    // multisampled like the window, so the times compare with --bench-tour
+    offscreenTarget.Init(headlessWidth, headlessHeight, gps::Window::SAMPLES);
+    outputFramebuffer = offscreenTarget.getFramebuffer();
+    glViewport(0, 0, headlessWidth, headlessHeight);
+    selfMove = true;
+    previousCameraPosition = myCamera.getPosition();
+
+    std::vector<double> frameMs;
+    for (int frame = 0; show; frame++) {
+        bool timed = frame >= HEADLESS_WARMUP_FRAMES;
+        double start = glfwGetTime();
+        // the camera stays at the start of the tour while warming up
+        if (timed)
+            simulationStep();
+        renderHeadlessFrame();
+        offscreenTarget.Resolve();
+        glFinish();
+        if (timed)
+            frameMs.push_back((glfwGetTime() - start) * 1000.0);
+        gps::CpuProfiler::EndFrame();
+        glCheckError();
     }
+    printHeadlessResult(frameMs);
+}
 
+// totals of every GPU scope, as JSON if the file name ends in .json and as CSV otherwise
+void writeGpuProfile() {
+    if (gpuProfileFile == NULL)
+        return;
+    size_t length = strlen(gpuProfileFile);
+    bool json = length >= 5 && strcmp(gpuProfileFile + length - 5, ".json") == 0;
+    if (json ? gpuProfiler.WriteJson(gpuProfileFile) : gpuProfiler.WriteCsv(gpuProfileFile))
+        std::cout << "GPU profile written to " << gpuProfileFile << std::endl;
+    else
+        std::cout << "ERROR: could not write the GPU profile to " << gpuProfileFile << std::endl;
 }
 
 void cleanup() {
+    jobSystem.Shutdown();
+    sceneBatch.Delete();
+    clusteredLights.Delete();
+    gBuffer.Delete();
+    shadowCascades.Delete();
+    offscreenTarget.Delete();
+    gpuProfiler.Delete();
     myWindow.Delete();
     //cleanup code for your own data
     glfwTerminate();
 }
 
 int main(int argc, const char* argv[]) {
+    gps::CpuProfiler::setThreadName("main (simulation)");
+    const char* traceFrames = getArgumentValue(argc, argv, "--trace=");
+    if (traceFrames != NULL)
+        gps::CpuProfiler::StartCapture(atoi(traceFrames), TRACE_FILE);
+
+    headless = hasArgument(argc, argv, "--headless");
+    const char* resolution = getArgumentValue(argc, argv, "--resolution=");
+    const char* separator = resolution != NULL ? strchr(resolution, 'x') : NULL;
+    if (separator != NULL && atoi(resolution) > 0 && atoi(separator + 1) > 0) {
+        headlessWidth = atoi(resolution);
+        headlessHeight = atoi(separator + 1);
+    }
+    else if (resolution != NULL) {
+        std::cerr << "Unknown resolution " << resolution << ", expected WIDTHxHEIGHT" << std::endl;
+    }
+    headlessResultFile = getArgumentValue(argc, argv, "--result=");
 
     try {
         initOpenGLWindow();
@@ -615,24 +1340,107 @@ int main(int argc, const char* argv[]) {
     }
 
     initOpenGLState();
+
+    const char* formatName = getArgumentValue(argc, argv, "--vertex-format=");
+    if (formatName != NULL && !gps::ParseVertexFormat(formatName, vertexFormat))
+        std::cerr << "Unknown vertex format " << formatName << ", expected full, oct16 or 1010102" << std::endl;
+
+    // compile every shader from source, e.g. to measure a cold start
+    if (hasArgument(argc, argv, "--no-shader-cache"))
+        gps::Shader::setBinaryCacheEnabled(false);
+
+    jobSystem.Init();
     initModels();
+    try {
+        initSceneGraph();
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        cleanup();
+        return EXIT_FAILURE;
+    }
     initSkyBox();
     initShaders();
     initUniforms();
-    setWindowCallbacks();
+    gpuProfiler.Init();
+    initStaticBatch();
+    initSceneBvh();
 
-    glCheckError();
-    // application loop
-    while (!glfwWindowShouldClose(myWindow.getWindow())) {
-        processMovement();
-        renderScene();
+    // --lights=N sets the number of point lamps of the night scene
+    const char* lightCount = getArgumentValue(argc, argv, "--lights=");
+    initPointLights(lightCount != NULL ? (size_t)atoi(lightCount) : DEFAULT_POINT_LIGHTS);
 
-        glfwPollEvents();
-        glfwSwapBuffers(myWindow.getWindow());
+    gBuffer.Init();
+    shadowCascades.Init();
+    controls.deferredShading = hasArgument(argc, argv, "--deferred");
 
-        glCheckError();
+    initOcclusionCuller();
+
+    if (hasArgument(argc, argv, "--bench-bvh")) {
+        sceneBvh.Benchmark(scene, model);
+    }
+
+    if (hasArgument(argc, argv, "--bench-transforms")) {
+        gps::TransformSystem::Benchmark(100000, 100);
+    }
+
+    if (hasArgument(argc, argv, "--bench-occlusion")) {
+        gps::BoxList sceneBoxes;
+        std::vector<gps::Mesh>& meshes = scene.getMeshes();
+        for (size_t i = 0; i < meshes.size(); i++)
+            sceneBoxes.push(meshes[i].bounds, model);
+        occlusionCuller.Benchmark(sceneBoxes, projection, 500);
+    }
+    if (hasArgument(argc, argv, "--bench-tour")) {
+        tourBenchmark = true;
+        selfMove = true;
+    }
+    // the render thread sets the swap interval, the simulation always runs at its fixed rate
+    const char* pacingName = getArgumentValue(argc, argv, "--pacing=");
+    if (pacingName != NULL && !gps::ParsePacingMode(pacingName, pacingMode))
+        std::cerr << "Unknown frame pacing " << pacingName << ", expected vsync, adaptive, uncapped or fixed" << std::endl;
+    // no vsync for throughput tests, same as --pacing=uncapped
+    if (hasArgument(argc, argv, "--uncapped"))
+        pacingMode = gps::PACING_UNCAPPED;
+    const char* frameRate = getArgumentValue(argc, argv, "--fps=");
+    if (frameRate != NULL && atof(frameRate) > 0.0)
+        fixedFrameRate = atof(frameRate);
+    lateLatching = hasArgument(argc, argv, "--late-latch");
+    gpuProfileFile = getArgumentValue(argc, argv, "--gpu-profile=");
+    if (headless) {
+        runHeadlessBenchmark();
+        writeGpuProfile();
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+    setWindowCallbacks();
+
+    glCheckError();
+    // application loop, the GL context moves to the render thread
+    previousCameraPosition = myCamera.getPosition();
+    simulationClock.Init(glfwGetTime());
+    publishSnapshot();
+    glfwMakeContextCurrent(NULL);
+    renderThread = std::thread(renderLoop);
+    while (running && !glfwWindowShouldClose(myWindow.getWindow())) {
+        int steps = simulationClock.Advance(glfwGetTime());
+        for (int i = 0; i < steps; i++)
+            simulationStep();
+        publishSnapshot();
+
+        // sleeps until the next step is due, input wakes it up earlier and goes out in a new snapshot
+        double wait = simulationClock.getStepTime() + simulationClock.getStep() - glfwGetTime();
+        CPU_SCOPE("wait for events");
+        if (wait > 0.0)
+            glfwWaitEventsTimeout(wait);
+        else
+            glfwPollEvents();
     }
+    running = false;
+    renderThread.join();
 
+    glfwMakeContextCurrent(myWindow.getWindow());
+    writeGpuProfile();
     cleanup();
 
     return EXIT_SUCCESS;
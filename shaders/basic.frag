@@ -1,24 +1,46 @@
 #version 410 core
 
 in vec3 fPosition;
-in vec3 fNormal;
+in vec3 fPosEye;
+in vec3 fNormalEye;
 in vec2 fTexCoords;
+#ifdef FOG
+in float fFogDistance;
+#endif
 
 out vec4 fColor;
 
-//matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
 //lighting
 uniform vec3 lightPosEye;
-uniform vec3 lightDir;
+// normalized direction towards the light, transformed to eye space once per frame on the CPU
+uniform vec3 lightDirEye;
 uniform vec3 lightColor;
-// textures
+// textures, FOG, SPECULAR_MAP, ALPHA_TEST, POINT_LIGHTS and SHADOWS are defined by gps::Shader for the variants that use them
 uniform sampler2D diffuseTexture;
+#ifdef SPECULAR_MAP
 uniform sampler2D specularTexture;
-
-uniform int fog;
+#endif
+#ifdef ALPHA_TEST
+uniform sampler2D alphaTexture;
+#endif
+#ifdef SHADOWS
+// cascades of the sun's shadow map, eye space to shadow map coordinates, far end and texel size of each
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform vec4 cascadeSplits;
+uniform vec4 shadowTexelSize;
+#endif
+#ifdef POINT_LIGHTS
+// eye space position and radius, then color, of every light
+uniform samplerBuffer pointLights;
+// offset and count of the lights of every cluster in lightIndices
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+// pixels per screen tile, and slice = log(depth) * clusterDepth.x - clusterDepth.y
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepth;
+uniform ivec3 clusterCount;
+#endif
 
 //components
 vec3 ambient;
@@ -31,17 +53,29 @@ float constant = 1.0f;
 float linear = 0.004f;
 float quadratic = 0.0001f;
 
-void computeDirLight()
+#ifdef SHADOWS
+// 1 where the sun reaches the point, see gps::ShadowCascades
+float computeShadow(vec3 posEye, vec3 normalEye)
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+    float depth = -posEye.z;
+    if (depth >= cascadeSplits.w)
+        return 1.0f;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : (depth < cascadeSplits.z ? 2 : 3));
+
+    //pushed out along the normal by a texel or two, against acne
+    vec4 position = shadowMatrices[cascade] * vec4(posEye + normalEye * 1.5f * shadowTexelSize[cascade], 1.0f);
+    return texture(shadowMap, vec4(position.xy, float(cascade), position.z));
+}
+#endif
 
-    //normalize light direction
-    vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
+void computeDirLight()
+{
+    //eye space coordinates come from the vertex shader
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 lightDirN = lightDirEye;
 
     //compute view direction (in eye coordinates, the viewer is situated at the origin
-    vec3 viewDir = normalize(- fPosEye.xyz);
+    vec3 viewDir = normalize(- fPosEye);
 
     //compute distance to light
     float distance = length(lightPosEye - fPosition.xyz);
@@ -59,33 +93,92 @@ void computeDirLight()
     vec3 reflectDir = reflect(-lightDirN, normalEye);
     float specCoeff = pow(max(dot(viewDir, reflectDir), 0.0f), 32);
     specular = att * specularStrength * specCoeff * lightColor;
+
+#ifdef SHADOWS
+    float shadow = computeShadow(fPosEye, normalEye);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
 }
 
+#ifdef POINT_LIGHTS
+// diffuse and specular light of the point lights in this fragment's cluster, see gps::ClusteredLights
+void computePointLights(out vec3 pointDiffuse, out vec3 pointSpecular)
+{
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 viewDir = normalize(- fPosEye);
+
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(-fPosEye.z) * clusterDepth.x - clusterDepth.y)));
+    cluster = clamp(cluster, ivec3(0), clusterCount - 1);
+    uvec2 lights = texelFetch(lightGrid, (cluster.z * clusterCount.y + cluster.y) * clusterCount.x + cluster.x).xy;
+
+    pointDiffuse = vec3(0.0f);
+    pointSpecular = vec3(0.0f);
+    for (uint i = 0u; i < lights.y; i++) {
+        int light = int(texelFetch(lightIndices, int(lights.x + i)).r);
+        vec4 positionRadius = texelFetch(pointLights, 2 * light);
+        vec3 pointColor = texelFetch(pointLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - fPosEye;
+        float distance = length(toLight);
+        //falls off smoothly to zero at the radius the light was binned with
+        float window = clamp(1.0f - pow(distance / positionRadius.w, 4.0f), 0.0f, 1.0f);
+        float att = window * window;
+        vec3 lightDirN = toLight / max(distance, 0.0001f);
+
+        pointDiffuse += att * max(dot(normalEye, lightDirN), 0.0f) * pointColor;
+        vec3 reflectDir = reflect(-lightDirN, normalEye);
+        pointSpecular += att * specularStrength * pow(max(dot(viewDir, reflectDir), 0.0f), 32) * pointColor;
+    }
+}
+#endif
+
+#ifdef FOG
 float computeFog()
 {
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
     float fogDensity = 0.01f;
-    float fragmentDistance = length(fPosEye);
+    float fragmentDistance = fFogDistance;
     float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
 
     return clamp(fogFactor, 0.0f, 1.0f);
 }
+#endif
 
 
 void main() 
 {
+#ifdef ALPHA_TEST
+    if (texture(alphaTexture, fTexCoords).r < 0.5f)
+        discard;
+#endif
+
     computeDirLight();
 
+    vec3 diffuseColor = texture(diffuseTexture, fTexCoords).rgb;
+#ifdef SPECULAR_MAP
+    vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
+#else
+    // the unset specular sampler used to read texture unit 0, the diffuse texture
+    vec3 specularColor = diffuseColor;
+#endif
+
+#ifdef POINT_LIGHTS
+    vec3 pointDiffuse, pointSpecular;
+    computePointLights(pointDiffuse, pointSpecular);
+    diffuse += pointDiffuse;
+    specular += pointSpecular;
+#endif
+
     //compute final vertex color
-    vec3 color = min((ambient + diffuse) * texture(diffuseTexture, fTexCoords).rgb + specular * texture(specularTexture, fTexCoords).rgb, 1.0f);
-
-    if (fog == 1){
-        float fogFactor = computeFog();
-        vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
-        vec4 colorF = vec4(color, 1.0f);
-        fColor = fogColor * (1 - fogFactor) + colorF * fogFactor;
-    } else {
-        fColor = vec4(color, 1.0f);
-    }
+    vec3 color = min((ambient + diffuse) * diffuseColor + specular * specularColor, 1.0f);
+
+#ifdef FOG
+    float fogFactor = computeFog();
+    vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    vec4 colorF = vec4(color, 1.0f);
+    fColor = fogColor * (1 - fogFactor) + colorF * fogFactor;
+#else
+    fColor = vec4(color, 1.0f);
+#endif
 
 }
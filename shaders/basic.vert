@@ -4,18 +4,49 @@ layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
+// object space position (light attenuation), eye space position and normal, distance for the fog
 out vec3 fPosition;
-out vec3 fNormal;
+out vec3 fPosEye;
+out vec3 fNormalEye;
 out vec2 fTexCoords;
+#ifdef FOG
+out float fFogDistance;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix;
+
+// packed vertex formats (VertexFormat.hpp): positions are normalized to the mesh box,
+// normals may be octahedral encoded in the first two components
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+uniform bool octahedralNormals;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// depth.vert computes the same position for the depth pre-pass
+invariant gl_Position;
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	vec3 position = vPosition * positionScale + positionBias;
+	vec4 positionEye = view * model * vec4(position, 1.0f);
+	gl_Position = projection * positionEye;
+	fPosition = position;
+	fPosEye = positionEye.xyz;
+	vec3 normal = octahedralNormals ? octahedralDecode(vNormal.xy) : vNormal;
+	fNormalEye = normalMatrix * normal;
 	fTexCoords = vTexCoords;
+#ifdef FOG
+	fFogDistance = length(positionEye);
+#endif
 }
@@ -0,0 +1,66 @@
+#version 430 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+// index of the draw inside the multi draw call (instanced, starts at baseInstance)
+layout(location=3) in uint vDrawId;
+
+// same outputs as basic.vert
+out vec3 fPosition;
+out vec3 fPosEye;
+out vec3 fNormalEye;
+out vec2 fTexCoords;
+#ifdef FOG
+out float fFogDistance;
+#endif
+flat out uint fMaterialIndex;
+
+struct PerDraw {
+	mat4 model;
+	mat4 normalModel;
+	vec4 positionScale;
+	vec4 positionBias;
+	uint materialIndex;
+};
+
+layout(std430, binding=0) readonly buffer PerDrawBuffer {
+	PerDraw draws[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+// inverse transpose of view, the per-draw normal matrices go to world space
+uniform mat3 normalMatrix;
+uniform bool octahedralNormals;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+// depthIndirect.vert computes the same position for the depth pre-pass
+invariant gl_Position;
+
+void main()
+{
+	PerDraw draw = draws[vDrawId];
+	vec3 position = vPosition * draw.positionScale.xyz + draw.positionBias.xyz;
+	vec4 worldPosition = draw.model * vec4(position, 1.0f);
+	vec4 positionEye = view * worldPosition;
+	gl_Position = projection * positionEye;
+	// the batch has no model matrix, so the "object space" position is the world position
+	fPosition = worldPosition.xyz;
+	fPosEye = positionEye.xyz;
+	vec3 normal = octahedralNormals ? octahedralDecode(vNormal.xy) : vNormal;
+	fNormalEye = normalMatrix * (mat3(draw.normalModel) * normal);
+	fTexCoords = vTexCoords;
+#ifdef FOG
+	fFogDistance = length(positionEye);
+#endif
+	fMaterialIndex = draw.materialIndex;
+}
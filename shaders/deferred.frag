@@ -0,0 +1,148 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+// lighting pass of the deferred path, the same lights and fog as basic.frag
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+// the attenuation of basic.frag uses the object space position, the scene's is the world one
+uniform mat4 inverseView;
+
+//lighting
+uniform vec3 lightPosEye;
+uniform vec3 lightDirEye;
+uniform vec3 lightColor;
+// FOG, POINT_LIGHTS and SHADOWS are defined by gps::Shader for the variants that use them
+#ifdef SHADOWS
+// cascades of the sun's shadow map, eye space to shadow map coordinates, far end and texel size of each
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[4];
+uniform vec4 cascadeSplits;
+uniform vec4 shadowTexelSize;
+#endif
+#ifdef POINT_LIGHTS
+uniform samplerBuffer pointLights;
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepth;
+uniform ivec3 clusterCount;
+#endif
+
+//components
+vec3 ambient;
+float ambientStrength = 0.2f;
+vec3 diffuse;
+vec3 specular;
+float specularStrength = 0.5f;
+
+float constant = 1.0f;
+float linear = 0.004f;
+float quadratic = 0.0001f;
+
+vec3 octahedralDecode(vec2 e)
+{
+    e = e * 2.0f - 1.0f;
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+#ifdef SHADOWS
+// 1 where the sun reaches the point, see gps::ShadowCascades
+float computeShadow(vec3 posEye, vec3 normalEye)
+{
+    float depth = -posEye.z;
+    if (depth >= cascadeSplits.w)
+        return 1.0f;
+    int cascade = depth < cascadeSplits.x ? 0 : (depth < cascadeSplits.y ? 1 : (depth < cascadeSplits.z ? 2 : 3));
+
+    //pushed out along the normal by a texel or two, against acne
+    vec4 position = shadowMatrices[cascade] * vec4(posEye + normalEye * 1.5f * shadowTexelSize[cascade], 1.0f);
+    return texture(shadowMap, vec4(position.xy, float(cascade), position.z));
+}
+#endif
+
+void computeDirLight(vec3 posEye, vec3 normalEye)
+{
+    vec3 viewDir = normalize(- posEye);
+    vec3 position = (inverseView * vec4(posEye, 1.0f)).xyz;
+    float distance = length(lightPosEye - position);
+    float att = 1.0f/(constant + linear * distance + quadratic * (distance * distance));
+
+    ambient = att * ambientStrength * lightColor;
+    diffuse = att * max(dot(normalEye, lightDirEye), 0.0f) * lightColor;
+    vec3 reflectDir = reflect(-lightDirEye, normalEye);
+    float specCoeff = pow(max(dot(viewDir, reflectDir), 0.0f), 32);
+    specular = att * specularStrength * specCoeff * lightColor;
+
+#ifdef SHADOWS
+    float shadow = computeShadow(posEye, normalEye);
+    diffuse *= shadow;
+    specular *= shadow;
+#endif
+}
+
+#ifdef POINT_LIGHTS
+void computePointLights(vec3 posEye, vec3 normalEye)
+{
+    vec3 viewDir = normalize(- posEye);
+
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(floor(log(-posEye.z) * clusterDepth.x - clusterDepth.y)));
+    cluster = clamp(cluster, ivec3(0), clusterCount - 1);
+    uvec2 lights = texelFetch(lightGrid, (cluster.z * clusterCount.y + cluster.y) * clusterCount.x + cluster.x).xy;
+
+    for (uint i = 0u; i < lights.y; i++) {
+        int light = int(texelFetch(lightIndices, int(lights.x + i)).r);
+        vec4 positionRadius = texelFetch(pointLights, 2 * light);
+        vec3 pointColor = texelFetch(pointLights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - posEye;
+        float distance = length(toLight);
+        float window = clamp(1.0f - pow(distance / positionRadius.w, 4.0f), 0.0f, 1.0f);
+        float att = window * window;
+        vec3 lightDirN = toLight / max(distance, 0.0001f);
+
+        diffuse += att * max(dot(normalEye, lightDirN), 0.0f) * pointColor;
+        vec3 reflectDir = reflect(-lightDirN, normalEye);
+        specular += att * specularStrength * pow(max(dot(viewDir, reflectDir), 0.0f), 32) * pointColor;
+    }
+}
+#endif
+
+void main()
+{
+    float depth = texture(gDepth, fTexCoords).r;
+    //nothing was drawn here, the sky box fills it afterwards
+    if (depth == 1.0f)
+        discard;
+    //the sky box and later passes test against the scene's depth
+    gl_FragDepth = depth;
+
+    vec4 positionClip = inverseProjection * vec4(vec3(fTexCoords, depth) * 2.0f - 1.0f, 1.0f);
+    vec3 posEye = positionClip.xyz / positionClip.w;
+    vec3 normalEye = octahedralDecode(texture(gNormal, fTexCoords).rg);
+    vec4 albedoSpecular = texture(gAlbedoSpecular, fTexCoords);
+
+    computeDirLight(posEye, normalEye);
+#ifdef POINT_LIGHTS
+    computePointLights(posEye, normalEye);
+#endif
+
+    vec3 color = min((ambient + diffuse) * albedoSpecular.rgb + specular * albedoSpecular.a, 1.0f);
+
+#ifdef FOG
+    float fogDensity = 0.01f;
+    float fogFactor = clamp(exp(-pow(length(posEye) * fogDensity, 2)), 0.0f, 1.0f);
+    vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    fColor = fogColor * (1 - fogFactor) + vec4(color, 1.0f) * fogFactor;
+#else
+    fColor = vec4(color, 1.0f);
+#endif
+}
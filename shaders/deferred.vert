@@ -0,0 +1,11 @@
+#version 410 core
+
+// full screen triangle for the lighting pass, drawn without vertex buffers
+out vec2 fTexCoords;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    fTexCoords = corner;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,21 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// decoding of packed positions, see basic.vert
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
+// same computation as basic.vert, so the main pass can test against these depths with GL_LEQUAL
+invariant gl_Position;
+
+void main()
+{
+	vec3 position = vPosition * positionScale + positionBias;
+	vec4 positionEye = view * model * vec4(position, 1.0f);
+	gl_Position = projection * positionEye;
+}
@@ -0,0 +1,31 @@
+#version 430 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=3) in uint vDrawId;
+
+struct PerDraw {
+	mat4 model;
+	mat4 normalModel;
+	vec4 positionScale;
+	vec4 positionBias;
+	uint materialIndex;
+};
+
+layout(std430, binding=0) readonly buffer PerDrawBuffer {
+	PerDraw draws[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// same computation as basicIndirect.vert
+invariant gl_Position;
+
+void main()
+{
+	PerDraw draw = draws[vDrawId];
+	vec3 position = vPosition * draw.positionScale.xyz + draw.positionBias.xyz;
+	vec4 worldPosition = draw.model * vec4(position, 1.0f);
+	vec4 positionEye = view * worldPosition;
+	gl_Position = projection * positionEye;
+}
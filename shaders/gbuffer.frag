@@ -0,0 +1,47 @@
+#version 410 core
+
+in vec3 fPosition;
+in vec3 fPosEye;
+in vec3 fNormalEye;
+in vec2 fTexCoords;
+
+// G-buffer pass of the deferred path, the layout is described in GBuffer.hpp
+layout(location=0) out vec4 gAlbedoSpecular;
+layout(location=1) out vec2 gNormal;
+
+// same material textures and SPECULAR_MAP/ALPHA_TEST variants as basic.frag
+uniform sampler2D diffuseTexture;
+#ifdef SPECULAR_MAP
+uniform sampler2D specularTexture;
+#endif
+#ifdef ALPHA_TEST
+uniform sampler2D alphaTexture;
+#endif
+
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0f)
+        e = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return e * 0.5f + 0.5f;
+}
+
+void main()
+{
+#ifdef ALPHA_TEST
+    if (texture(alphaTexture, fTexCoords).r < 0.5f)
+        discard;
+#endif
+
+    vec3 diffuseColor = texture(diffuseTexture, fTexCoords).rgb;
+    //the specular color is kept as its luminance only
+#ifdef SPECULAR_MAP
+    vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
+#else
+    vec3 specularColor = diffuseColor;
+#endif
+
+    gAlbedoSpecular = vec4(diffuseColor, dot(specularColor, vec3(0.299f, 0.587f, 0.114f)));
+    gNormal = octahedralEncode(normalize(fNormalEye));
+}